@@ -0,0 +1,66 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+
+namespace p2c {
+
+// sizes of the hash tables of a query: capacity hints for the generated code and the sizes observed when it runs
+//
+// A hash table is identified by the hash of the fingerprint of the subplan
+// whose tuples it holds (the build side of a join, the groups of an
+// aggregation), so its id is the same in every compilation of the plan.
+// Generated code reserves capacity for hint(id, estimate) tuples and reports
+// the actual number with record(id, n) once the table is built. In library
+// mode, p2c reads the sizes observed in earlier runs from the plan's feedback
+// file and writes them back after the query ran. The hints are read at
+// runtime, so cached queries use new feedback without being recompiled.
+// Generated code calls hint and record between pipelines (not thread-safe).
+class Cardinalities {
+   std::map<uint64_t, uint64_t> observed;
+   bool changed = false;
+
+public:
+   // observed size of a hash table, or the compiled-in estimate (0 if unknown) if it was never observed
+   uint64_t hint(uint64_t id, uint64_t estimate = 0) const {
+      auto it = observed.find(id);
+      return it == observed.end() ? estimate : it->second;
+   }
+
+   void record(uint64_t id, uint64_t size) {
+      auto [it, inserted] = observed.try_emplace(id, size);
+      changed |= inserted || it->second != size;
+      it->second = size;
+   }
+
+   // feedback file with one line '<id in hex> <size>' per hash table; empty if the file does not exist
+   static Cardinalities read(const std::filesystem::path& file) {
+      Cardinalities result;
+      std::ifstream in(file);
+      uint64_t id, size;
+      while (in >> std::hex >> id >> std::dec >> size)
+         result.observed[id] = size;
+      return result;
+   }
+
+   // write feedback file if a size was recorded that differs from the file (renamed into place, so concurrent readers never see partial files)
+   void write(const std::filesystem::path& file) const {
+      if (!changed)
+         return;
+      auto tmp = file;
+      tmp += "." + std::to_string(getpid()) + ".tmp";
+      {
+         std::ofstream out(tmp);
+         for (auto [id, size] : observed)
+            out << std::hex << id << ' ' << std::dec << size << '\n';
+      }
+      std::filesystem::rename(tmp, file);
+   }
+};
+
+}  // namespace p2c
@@ -0,0 +1,40 @@
+#!/bin/bash
+# run the test plans in every execution mode and compare their results with the generated C++ code (baseline)
+# usage: ./check.sh [data dir] (default: data-generator/output/)
+data=${1:-data-generator/output/}
+plans="q5 groupby sort sortstring topk limit"
+modes=("--vectorized" "--tiered" "--no-optimize" "--radix-threshold 0" "--interpret" "--llvm")
+# the baseline runs with one worker; all modes (and the generated C++ code) run with one worker and with several, so
+# the paths that combine the workers' state (merges, splitters, limits) are checked on single-core hosts as well
+workers="1 4"
+test -x ./p2c || { echo "p2c not found (run make p2c)"; exit 1; }
+
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+failed=0
+for plan in $plans; do
+   if ! ./p2c --plan "$plan" --no-cache --run "$data" 1 1 >"$out/$plan" 2>"$out/log"; then
+      echo "FAIL $plan (baseline)"; cat "$out/log"; failed=1; continue
+   fi
+   for threads in $workers; do
+      for mode in "" "${modes[@]}"; do
+         test -z "$mode" && test "$threads" = 1 && continue
+         name="$plan ${mode:-(generated C++)} ($threads workers)"
+         if ! ./p2c --plan "$plan" $mode --no-cache --run "$data" 1 "$threads" >"$out/result" 2>"$out/log"; then
+            if grep -q "built without LLVM" "$out/log"; then
+               echo "skip $name (p2c built without LLVM)"; continue
+            fi
+            echo "FAIL $name"; cat "$out/log"; failed=1; continue
+         fi
+         # all plans have ordered results, so the output must be identical
+         if cmp -s "$out/$plan" "$out/result"; then
+            echo "ok   $name"
+         else
+            echo "FAIL $name (result differs from baseline)"
+            diff "$out/$plan" "$out/result" | head -10
+            failed=1
+         fi
+      done
+   done
+done
+exit $failed
@@ -0,0 +1,390 @@
+#pragma once
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "cardinalities.hpp"
+#include "parallel.hpp"
+#include "params.hpp"
+#include "tiering.hpp"
+#include "tpch.hpp"
+
+namespace p2c {
+
+// entry point exported by compiled queries
+using QueryFn = void (*)(TPCH& db, ThreadPool& pool, const QueryParams& params, Tiering& tiering, Cardinalities& cardinalities);
+static constexpr const char* queryEntryPoint = "p2cQuery";
+// returns the TierTable of the query's pipelines
+static constexpr const char* tierTableEntryPoint = "p2cTierTable";
+
+// how generated code is compiled into a shared object
+struct CompileOptions {
+   // compiler, $CXX if set
+   std::string compiler = getenv("CXX") ? getenv("CXX") : "c++";
+   std::string optimization = "-O0";
+   std::string flags = "-std=c++23 -g -Wall -march=native -pthread";
+   // directory containing query.hpp and the runtime headers (p2c is built next to them)
+   std::string includeDir = std::filesystem::canonical("/proc/self/exe").parent_path().string();
+};
+
+// query loaded into the running process
+class CompiledQuery {
+   void* handle = nullptr;
+   QueryFn fn = nullptr;
+   const TierTable* tiers = nullptr;
+
+public:
+   explicit CompiledQuery(const std::string& soPath) {
+      handle = dlopen(soPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+      if (!handle)
+         throw std::runtime_error(std::string("dlopen failed: ") + dlerror());
+      fn = reinterpret_cast<QueryFn>(dlsym(handle, queryEntryPoint));
+      if (!fn) {
+         dlclose(handle);
+         throw std::runtime_error(std::string("query entry point not found: ") + dlerror());
+      }
+      if (auto tierFn = reinterpret_cast<const TierTable* (*)()>(dlsym(handle, tierTableEntryPoint)))
+         tiers = tierFn();
+   }
+   ~CompiledQuery() {
+      if (handle)
+         dlclose(handle);
+   }
+   CompiledQuery(const CompiledQuery&) = delete;
+
+   void operator()(TPCH& db, ThreadPool& pool, const QueryParams& params, Tiering& tiering, Cardinalities& cardinalities) const { fn(db, pool, params, tiering, cardinalities); }
+
+   // morsel functions of the query's pipelines
+   const TierTable* tierTable() const { return tiers; }
+};
+
+// temporary directory that is removed with all its files
+struct TempDir {
+   std::filesystem::path path;
+
+   TempDir() {
+      std::string pattern = (std::filesystem::temp_directory_path() / "p2c-XXXXXX").string();
+      if (!mkdtemp(pattern.data()))
+         throw std::runtime_error("could not create temporary directory");
+      path = pattern;
+   }
+   ~TempDir() { std::filesystem::remove_all(path); }
+};
+
+// redirects stdout (where p2c prints generated code) into a file while alive
+class StdoutRedirect {
+   int saved;
+
+public:
+   explicit StdoutRedirect(const std::filesystem::path& file, bool append = false) {
+      std::cout.flush();
+      fflush(stdout);
+      saved = dup(STDOUT_FILENO);
+      int fd = open(file.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+      if (saved < 0 || fd < 0)
+         throw std::runtime_error("could not redirect output to " + file.string());
+      dup2(fd, STDOUT_FILENO);
+      close(fd);
+   }
+   ~StdoutRedirect() {
+      std::cout.flush();
+      fflush(stdout);
+      dup2(saved, STDOUT_FILENO);
+      close(saved);
+   }
+   StdoutRedirect(const StdoutRedirect&) = delete;
+};
+
+// generated code is split into translation units that are compiled in parallel (see genPipeline in p2c.cpp)
+//
+// state.hpp declares struct QueryState, whose members are the state shared by
+// the query's pipelines, pipelineN.cpp defines the morsel function of pipeline
+// N, and query.cpp defines QueryState::run (the code between the pipelines)
+// and the entry points. QueryState is in a namespace with hidden visibility, so
+// two builds of the same query that are loaded at the same time do not share
+// code or their TierTables.
+static constexpr const char* generatedNamespace = "namespace generated __attribute__((visibility(\"hidden\"))) {\n";
+
+inline std::string stateHeaderPrologue() {
+   return std::string("#pragma once\n") + generatedNamespace +
+          "struct QueryState {\n"
+          "TPCH& db;\n"
+          "ThreadPool& pool;\n"
+          "const QueryParams& params;\n"
+          "Tiering& tiering;\n"
+          "Cardinalities& cardinalities;\n";
+}
+inline std::string stateHeaderEpilogue(unsigned pipelineCount) {
+   std::string result;
+   for (unsigned i = 0; i != pipelineCount; i++)
+      result += "void pipeline" + std::to_string(i) + "(uint64_t begin, uint64_t end);\n";
+   return result + "void run();\n};\n}  // namespace generated\n";
+}
+inline std::string queryPrologue() {
+   return std::string("#include \"query.hpp\"\n#include \"state.hpp\"\n") + generatedNamespace +
+          "TierTable tierTable;\n"
+          "void QueryState::run() {\n";
+}
+// perfRepeat - 1 runs of the query per call of the entry point (like the query loop in queryFrame.cpp)
+inline std::string queryEpilogue(unsigned perfRepeat) {
+   return std::string("}\n}  // namespace generated\n") +  //
+          "extern \"C\" void " + queryEntryPoint + "(TPCH& db, ThreadPool& pool, const QueryParams& params, Tiering& tiering, Cardinalities& cardinalities) {\n" +
+          "for (unsigned repeat = 0; repeat != " + std::to_string(perfRepeat - 1) + "; repeat++) {\n" +
+          "generated::QueryState state{db, pool, params, tiering, cardinalities};\n"
+          "state.run();\n"
+          "}\n}\n" +
+          "extern \"C\" const TierTable* " + tierTableEntryPoint + "() { return &generated::tierTable; }\n";
+}
+
+// thrown by a build that was cancelled (see runCommand)
+struct BuildCancelled : std::runtime_error {
+   BuildCancelled() : std::runtime_error("build cancelled") {}
+};
+
+// run a shell command and return its exit status like std::system; if cancel is set while it runs, the command and
+// all processes it started are killed and BuildCancelled is thrown
+inline int runCommand(const std::string& cmd, const std::atomic<bool>* cancel = nullptr) {
+   if (!cancel)
+      return std::system(cmd.c_str());
+   if (*cancel)
+      throw BuildCancelled();
+   pid_t pid = fork();
+   if (pid < 0)
+      return -1;
+   if (pid == 0) {
+      // own process group, so the compiler processes of the shell can be killed together
+      setpgid(0, 0);
+      execl("/bin/sh", "sh", "-c", cmd.c_str(), nullptr);
+      _exit(127);
+   }
+   setpgid(pid, pid);
+   int status;
+   while (waitpid(pid, &status, WNOHANG) == 0) {
+      if (*cancel) {
+         kill(-pid, SIGKILL);
+         waitpid(pid, &status, 0);
+         throw BuildCancelled();
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   }
+   return status;
+}
+
+inline std::string compilerCommand(const CompileOptions& options) { return options.compiler + " " + options.optimization + " " + options.flags + " -fPIC"; }
+
+// precompile the runtime headers (query.hpp) into dir with the options generated code is compiled with, unless done before
+//
+// dir is searched before the include directory and contains query.hpp, which
+// includes the runtime's query.hpp, precompiled as query.hpp.gch. gcc uses it
+// for '#include "query.hpp"' (other compilers ignore it and parse the
+// headers). -Winvalid-pch reports when it cannot be used.
+inline void precompileHeader(const std::filesystem::path& dir, const CompileOptions& options, const std::atomic<bool>* cancel = nullptr) {
+   auto header = dir / "query.hpp", pch = dir / "query.hpp.gch";
+   if (std::filesystem::exists(pch))
+      return;
+   std::filesystem::create_directories(dir);
+   // (files are renamed into place, so concurrent compilations never see partial files)
+   std::string suffix = "." + std::to_string(getpid()) + ".tmp";
+   auto tmpHeader = header, tmp = pch;
+   tmpHeader += suffix;
+   tmp += suffix;
+   std::ofstream(tmpHeader) << "#include \"" << (std::filesystem::path(options.includeDir) / "query.hpp").string() << "\"\n";
+   std::filesystem::rename(tmpHeader, header);
+   std::string cmd = compilerCommand(options) + " -x c++-header -o " + tmp.string() + " " + header.string();
+   if (runCommand(cmd, cancel) != 0)
+      throw std::runtime_error("compilation failed: " + cmd);
+   std::filesystem::rename(tmp, pch);
+}
+
+// compile sources concurrently (one compiler process per core) and link them into a shared object, using the precompiled header in pchDir
+// (setting cancel kills the compiler processes, see runCommand)
+inline void compileUnits(const std::vector<std::filesystem::path>& sources, const std::filesystem::path& so, const CompileOptions& options,
+                         const std::filesystem::path& pchDir, const std::atomic<bool>* cancel = nullptr) {
+   precompileHeader(pchDir, options, cancel);
+   std::vector<std::string> objects;
+   for (auto& src : sources)
+      objects.push_back((src.parent_path() / (src.stem().string() + options.optimization + ".o")).string());
+   std::atomic<size_t> next{0};
+   std::atomic<bool> failed{false};
+   std::vector<std::thread> threads;
+   for (unsigned t = 0; t != std::max(1u, std::min<unsigned>(std::thread::hardware_concurrency(), sources.size())); t++)
+      threads.emplace_back([&]() {
+         for (size_t i; (i = next++) < sources.size() && !failed;) {
+            std::string cmd = compilerCommand(options) + " -Winvalid-pch -I" + pchDir.string() + " -I" + options.includeDir + " -c -o " + objects[i] + " " + sources[i].string();
+            try {
+               if (runCommand(cmd, cancel) != 0)
+                  failed = true;
+            } catch (const BuildCancelled&) {
+               failed = true;
+            }
+         }
+      });
+   for (auto& t : threads)
+      t.join();
+   if (cancel && *cancel)
+      throw BuildCancelled();
+   if (failed)
+      throw std::runtime_error("compilation of generated code failed");
+   std::string cmd = compilerCommand(options) + " -shared -o " + so.string();
+   for (auto& object : objects)
+      cmd += " " + object;
+   if (runCommand(cmd, cancel) != 0)
+      throw std::runtime_error("linking failed: " + cmd);
+}
+
+// 64-bit FNV-1a hash
+inline uint64_t fnv1a(std::string_view data, uint64_t hash = 0xcbf29ce484222325ull) {
+   for (unsigned char c : data) {
+      hash ^= c;
+      hash *= 0x100000001b3ull;
+   }
+   return hash;
+}
+
+// whole file content, empty if it cannot be read
+inline std::string readFile(const std::filesystem::path& file) {
+   std::ifstream in(file, std::ios::binary);
+   std::ostringstream out;
+   out << in.rdbuf();
+   return out.str();
+}
+
+// output of a shell command
+inline std::string commandOutput(const std::string& cmd) {
+   std::string result;
+   if (FILE* pipe = popen(cmd.c_str(), "r")) {
+      char buffer[256];
+      while (size_t n = fread(buffer, 1, sizeof(buffer), pipe))
+         result.append(buffer, n);
+      pclose(pipe);
+   }
+   return result;
+}
+
+// identity of the running p2c build: the GNU build-id the linker embedded into the executable (read from memory), or
+// the size and modification time of the executable if there is none
+inline std::string executableId() {
+   std::string id;
+   dl_iterate_phdr([](dl_phdr_info* info, size_t, void* data) {
+      auto& id = *static_cast<std::string*>(data);
+      for (int i = 0; i != info->dlpi_phnum && id.empty(); ++i) {
+         auto& header = info->dlpi_phdr[i];
+         if (header.p_type != PT_NOTE)
+            continue;
+         auto note = reinterpret_cast<const char*>(info->dlpi_addr + header.p_vaddr), end = note + header.p_memsz;
+         while (id.empty() && note + sizeof(ElfW(Nhdr)) <= end) {
+            auto& nhdr = *reinterpret_cast<const ElfW(Nhdr)*>(note);
+            auto name = note + sizeof(nhdr), desc = name + ((nhdr.n_namesz + 3) & ~3u);
+            if (nhdr.n_type == NT_GNU_BUILD_ID && nhdr.n_namesz == 4 && !memcmp(name, "GNU", 4))
+               id = "build-id " + std::string(desc, nhdr.n_descsz);
+            note = desc + ((nhdr.n_descsz + 3) & ~3u);
+         }
+      }
+      // the first object is the executable
+      return 1;
+   }, &id);
+   struct stat exe;
+   if (id.empty() && stat("/proc/self/exe", &exe) == 0)
+      id = "exe " + std::to_string(exe.st_size) + " " + std::to_string(exe.st_mtim.tv_sec) + "." + std::to_string(exe.st_mtim.tv_nsec);
+   return id;
+}
+
+// on-disk cache of compiled queries
+//
+// A query is identified by the fingerprint of its plan. The key also covers
+// everything else the shared object depends on: the compiler (and its
+// version), the optimization level and flags, the p2c build (code generator, see executableId),
+// and the runtime headers including the schema. Entries are stored as <hash>.so together with
+// <hash>.key containing the full key, so hash collisions are detected.
+class QueryCache {
+   std::filesystem::path dir;
+   std::string environment;
+
+   std::filesystem::path entry(const std::string& key, const char* extension) const {
+      std::ostringstream name;
+      name << std::hex << fnv1a(key) << extension;
+      return dir / name.str();
+   }
+
+public:
+   explicit QueryCache(std::filesystem::path cacheDir = defaultDir(), const CompileOptions& options = {}) : dir(std::move(cacheDir)) {
+      std::filesystem::create_directories(dir);
+      uint64_t hash = fnv1a(executableId());
+      for (auto& f : std::filesystem::directory_iterator(options.includeDir))
+         if (f.path().extension() == ".hpp")
+            hash = fnv1a(readFile(f.path()), fnv1a(f.path().filename().string(), hash));
+      std::ostringstream env;
+      env << commandOutput(options.compiler + " --version 2>&1") << std::hex << hash << "\n";
+      environment = env.str();
+   }
+
+   // $P2C_CACHE_DIR, or p2c within the user's cache directory
+   static std::filesystem::path defaultDir() {
+      if (auto dir = getenv("P2C_CACHE_DIR"))
+         return dir;
+      if (auto dir = getenv("XDG_CACHE_HOME"))
+         return std::filesystem::path(dir) / "p2c";
+      if (auto dir = getenv("HOME"))
+         return std::filesystem::path(dir) / ".cache" / "p2c";
+      return std::filesystem::temp_directory_path() / "p2c-cache";
+   }
+
+   // full cache key of a plan fingerprint compiled with options
+   std::string key(const std::string& fingerprint, const CompileOptions& options) const {
+      return environment + options.compiler + " " + options.optimization + " " + options.flags + " -I" + options.includeDir + "\n" + fingerprint + "\n";
+   }
+
+   // shared object compiled for key, if cached
+   std::optional<std::filesystem::path> lookup(const std::string& key) const {
+      auto so = entry(key, ".so");
+      if (!std::filesystem::exists(so) || readFile(entry(key, ".key")) != key)
+         return std::nullopt;
+      return so;
+   }
+
+   // directory of the runtime headers precompiled with options (see precompileHeader), shared by all cached queries
+   std::filesystem::path headerDir(const CompileOptions& options) const { return entry(key("query.hpp", options), ".pch"); }
+
+   // compile query into shared object with compile(path) and store it under key (files are renamed into place, so concurrent readers never see partial
+   // files; the key last, so it never refers to a missing or stale shared object)
+   template<typename CompileFn>
+   std::filesystem::path insert(const std::string& key, CompileFn compile) const {
+      auto so = entry(key, ".so"), keyFile = entry(key, ".key");
+      std::string suffix = "." + std::to_string(getpid()) + ".tmp";
+      auto tmpSo = so, tmpKey = keyFile;
+      tmpSo += suffix;
+      tmpKey += suffix;
+      compile(tmpSo);
+      std::ofstream(tmpKey, std::ios::binary) << key;
+      std::filesystem::rename(tmpSo, so);
+      std::filesystem::rename(tmpKey, keyFile);
+      return so;
+   }
+};
+
+}  // namespace p2c
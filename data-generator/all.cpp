@@ -1,8 +1,10 @@
 // Maximilian Kuschewski, 2023
+#include <algorithm>
 #include <array>
 #include <filesystem>
 #include <iostream>
 #include <string_view>
+#include <thread>
 
 #include "csv.hpp"
 #include "table-reader.hpp"
@@ -15,10 +17,12 @@ int main(int argc, char *argv[]) {
    // takes one argument: the directory containing all database tables
    assert(argc == 2);
    fs::path iprefix(argv[1]);
+   // the large tables are parsed and written by all cores
+   auto threads = std::max(std::thread::hardware_concurrency(), 1u);
    // orders
    {
       orders::reader reader("output/orders/", (iprefix / "orders.tbl").c_str(), orders_c.data());
-      auto rows = reader.read();
+      auto rows = reader.read(threads);
       std::cout << "read " << rows << " rows for orders" << std::endl;
    }
    // nation
@@ -36,7 +40,7 @@ int main(int argc, char *argv[]) {
    // lineitem
    {
       lineitem::reader reader("output/lineitem/", (iprefix / "lineitem.tbl").c_str(), lineitem_c.data());
-      auto rows = reader.read();
+      auto rows = reader.read(threads);
       std::cout << "read " << rows << " rows for lineitem" << std::endl;
    }
    // part
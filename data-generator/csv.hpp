@@ -3,8 +3,11 @@
 
 #include <x86intrin.h>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
 #include <string>
@@ -142,6 +145,99 @@ inline double parse_double(CharIter &pos) {
    return result;
 }
 
+// SWAR (SIMD within a register) parsers for the fixed formats of TPC-H: integers, decimals with few fraction digits,
+// and dates. They convert 8 characters at a time and thus need 16 readable bytes at the field; near the end of the
+// input and for fields that do not match the format, they fall back to the generic parsers above.
+constexpr uint64_t ASCII_ZEROS = 0x3030303030303030ull;
+constexpr uint64_t POWERS_OF_TEN[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+inline uint64_t load_chunk(const char *iter) {
+   uint64_t chunk;
+   std::memcpy(&chunk, iter, sizeof(chunk));
+   return chunk;
+}
+
+// number of leading decimal digits of the 8 characters in chunk (the first character is the lowest byte)
+inline unsigned swar_digit_count(uint64_t chunk) {
+   uint64_t x = chunk - ASCII_ZEROS;
+   // digits are below 10 after the subtraction; borrows and carries only change the bytes behind a non-digit
+   uint64_t non_digits = (x | (x + 0x7676767676767676ull)) & 0x8080808080808080ull;
+   return non_digits ? __builtin_ctzll(non_digits) / 8 : 8;
+}
+
+// value of the first n (1 to 8) characters of chunk, which must be digits
+inline uint64_t swar_digits(uint64_t chunk, unsigned n) {
+   // move the digits to the top, the bytes below become leading zeros
+   uint64_t x = (chunk - ASCII_ZEROS) << (8 * (8 - n));
+   // combine adjacent digits, then pairs of two-digit and four-digit numbers
+   x = x * 10 + (x >> 8);
+   return (((x & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+           (((x >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+}
+
+// unsigned integer of at most 15 digits at pos; false if there are no digits, too many, or less than 16 bytes left
+inline bool parse_digits_swar(CharIter &pos, uint64_t &value, unsigned &digits) {
+   if (pos.limit - pos.iter < 16) {
+      return false;
+   }
+   auto chunk = load_chunk(pos.iter);
+   digits = swar_digit_count(chunk);
+   if (digits == 0) {
+      return false;
+   }
+   value = swar_digits(chunk, digits);
+   if (digits == 8) {
+      chunk = load_chunk(pos.iter + 8);
+      auto n = swar_digit_count(chunk);
+      if (n == 8) {
+         return false;
+      } else if (n) {
+         value = value * POWERS_OF_TEN[n] + swar_digits(chunk, n);
+         digits += n;
+      }
+   }
+   pos.iter += digits;
+   return true;
+}
+
+template<char delim, char eol = '\n'>
+inline long parse_int_swar(CharIter &pos) {
+   auto start = pos;
+   bool negative = *pos.iter == '-';
+   pos.iter += negative;
+   uint64_t value;
+   unsigned digits;
+   if (parse_digits_swar(pos, value, digits) && (*pos.iter == delim || *pos.iter == eol)) {
+      return negative ? -static_cast<long>(value) : static_cast<long>(value);
+   }
+   pos = start;
+   return parse_int<delim, eol>(pos);
+}
+
+// decimal with at most 8 fraction digits (e.g., 1234.56) and 15 digits in total; the result is exact (the same as
+// strtod) as both integer and scaled fraction fit into the mantissa and the division is correctly rounded
+template<char delim, char eol = '\n'>
+inline double parse_decimal_swar(CharIter &pos) {
+   auto start = pos;
+   bool negative = *pos.iter == '-';
+   pos.iter += negative;
+   uint64_t integer, fraction = 0;
+   unsigned digits, scale = 0;
+   if (parse_digits_swar(pos, integer, digits)) {
+      bool valid = true;
+      if (*pos.iter == '.') {
+         ++pos.iter;
+         valid = parse_digits_swar(pos, fraction, scale) && scale <= 8;
+      }
+      if (valid && digits + scale <= 15 && (*pos.iter == delim || *pos.iter == eol)) {
+         double value = static_cast<double>(integer * POWERS_OF_TEN[scale] + fraction) / POWERS_OF_TEN[scale];
+         return negative ? -value : value;
+      }
+   }
+   pos = start;
+   return parse_double<delim, eol>(pos);
+}
+
 template<typename Executor>
 inline void parallel_exec(const Executor &executor,
                           unsigned thread_count = std::thread::hardware_concurrency() / 2) {
@@ -197,7 +293,7 @@ struct Parser<long> {
    static constexpr char TYPE_NAME[] = "long";
    template<char delim, char eol = '\n'>
    inline long parse_value(CharIter &pos) {
-      return parse_int<delim, eol>(pos);
+      return parse_int_swar<delim, eol>(pos);
    }
 };
 
@@ -206,7 +302,7 @@ struct Parser<int> {
    static constexpr char TYPE_NAME[] = "int";
    template<char delim, char eol = '\n'>
    inline int parse_value(CharIter &pos) {
-      return parse_int<delim, eol>(pos);
+      return parse_int_swar<delim, eol>(pos);
    }
 };
 
@@ -215,7 +311,7 @@ struct Parser<double> {
    static constexpr char TYPE_NAME[] = "double";
    template<char delim, char eol = '\n'>
    inline double parse_value(CharIter &pos) {
-      return parse_double<delim, eol>(pos);
+      return parse_decimal_swar<delim, eol>(pos);
    }
 };
 
@@ -272,9 +368,7 @@ inline std::size_t read_file(const char *filename, const std::vector<unsigned> &
 }
 
 template<char delim = ',', char eol = '\n', typename Consumer>
-inline std::size_t read_file(const FileMapping<char> &input, const std::vector<unsigned> &cols,
-                             const Consumer &consumer) {
-   auto pos = CharIter::from_iterable(input);
+inline std::size_t read_chunk(CharIter pos, const std::vector<unsigned> &cols, const Consumer &consumer) {
    std::size_t lines{0};
    while (read_line<delim, eol, Consumer>(pos, cols, consumer)) {
       ++lines;
@@ -282,4 +376,46 @@ inline std::size_t read_file(const FileMapping<char> &input, const std::vector<u
    return lines;
 }
 
+template<char delim = ',', char eol = '\n', typename Consumer>
+inline std::size_t read_file(const FileMapping<char> &input, const std::vector<unsigned> &cols,
+                             const Consumer &consumer) {
+   return read_chunk<delim, eol, Consumer>(CharIter::from_iterable(input), cols, consumer);
+}
+
+// number of lines of input (the last line may lack its line break), an upper bound of the rows read_file returns
+template<char eol = '\n'>
+inline std::size_t count_lines(const FileMapping<char> &input) {
+   auto [iter, limit] = CharIter::from_iterable(input);
+   std::size_t lines = 0;
+   const __m256i search_mask = _mm256_set1_epi8(eol);
+   for (; iter + 32 <= limit; iter += 32) {
+      auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(iter));
+      lines += _mm_popcnt_u32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, search_mask)));
+   }
+   for (; iter != limit; ++iter) {
+      lines += *iter == eol;
+   }
+   return lines + (input.file_size && input.data()[input.file_size - 1] != eol);
+}
+
+// split input into at most n chunks of whole lines of about the same size (for parallel parsing)
+template<char eol = '\n'>
+inline std::vector<CharIter> split_lines(const FileMapping<char> &input, unsigned n) {
+   std::vector<CharIter> chunks;
+   auto all = CharIter::from_iterable(input);
+   auto size = static_cast<std::size_t>(all.limit - all.iter);
+   auto begin = all.iter;
+   for (auto i = 1u; i <= n && begin != all.limit; ++i) {
+      // end the chunk after the first line break behind its nominal end
+      CharIter end{i == n ? all.limit : std::max(begin, all.iter + size * i / n), all.limit};
+      if (end.iter != all.limit) {
+         find<eol>(end);
+         end.iter += end.iter != all.limit;
+      }
+      chunks.push_back({begin, end.iter});
+      begin = end.iter;
+   }
+   return chunks;
+}
+
 }  // namespace p2c::csv
@@ -0,0 +1,100 @@
+// benchmark of the SWAR parsers for TPC-H integers, decimals and dates against the generic parsers they replace
+// (strtol, strtod, and stringToType<date>); also checks that both return the same values
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "csv.hpp"
+#include "tpch.hpp"
+
+using namespace p2c;
+
+static constexpr unsigned FIELDS = 1u << 22;
+static constexpr unsigned REPETITIONS = 5;
+
+// FIELDS values of the given format, separated by '|'
+template<typename Generator>
+static std::string make_input(const Generator &generate) {
+   std::string input;
+   for (auto i = 0u; i != FIELDS; ++i) {
+      input += generate();
+      input += '|';
+   }
+   // the SWAR parsers fall back to the generic ones for the last 16 bytes
+   return input;
+}
+
+// best time of REPETITIONS runs of parsing all fields of input with parse, in ns per field; values holds the results
+template<typename T, typename Parse>
+static double measure(const std::string &input, std::vector<T> &values, const Parse &parse) {
+   double best = 1e100;
+   for (auto r = 0u; r != REPETITIONS; ++r) {
+      values.clear();
+      auto begin = std::chrono::steady_clock::now();
+      csv::CharIter pos{input.data(), input.data() + input.size()};
+      while (pos.iter != pos.limit) {
+         values.push_back(parse(pos));
+         ++pos.iter;
+      }
+      std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+      best = std::min(best, elapsed.count() / FIELDS);
+   }
+   return best;
+}
+
+template<typename T, typename Generic, typename Swar>
+static bool compare(const char *name, const std::string &input, const Generic &generic, const Swar &swar) {
+   std::vector<T> expected, actual;
+   auto before = measure(input, expected, generic);
+   auto after = measure(input, actual, swar);
+   std::printf("%-8s generic: %6.2f ns/value, swar: %6.2f ns/value, speedup: %.2fx\n", name, before, after,
+               before / after);
+   for (auto i = 0ul; i != expected.size(); ++i) {
+      if (!(expected[i] == actual[i])) {
+         std::cerr << name << ": value " << i << " differs" << std::endl;
+         return false;
+      }
+   }
+   return expected.size() == actual.size();
+}
+
+int main() {
+   std::mt19937_64 random(42);
+   auto uniform = [&](int64_t min, int64_t max) { return std::uniform_int_distribution<int64_t>(min, max)(random); };
+
+   // keys of all lengths up to SF1000 orderkeys
+   auto integers = make_input([&] { return std::to_string(uniform(1, std::pow(10, uniform(1, 10)))); });
+   // prices and account balances (two decimals, may be negative), quantities (no decimals), discounts
+   auto decimals = make_input([&] {
+      char buffer[32];
+      switch (uniform(0, 3)) {
+         case 0: std::snprintf(buffer, sizeof(buffer), "%ld.%02ld", uniform(900, 104950), uniform(0, 99)); break;
+         case 1: std::snprintf(buffer, sizeof(buffer), "%.2f", uniform(-99999, 999999) / 100.0); break;
+         case 2: std::snprintf(buffer, sizeof(buffer), "%ld", uniform(1, 50)); break;
+         default: std::snprintf(buffer, sizeof(buffer), "0.%02ld", uniform(0, 10));
+      }
+      return std::string(buffer);
+   });
+   auto dates = make_input([&] {
+      char buffer[32];
+      std::snprintf(buffer, sizeof(buffer), "%04ld-%02ld-%02ld", uniform(1992, 1998), uniform(1, 12), uniform(1, 28));
+      return std::string(buffer);
+   });
+
+   bool equal = true;
+   equal &= compare<int32_t>("integer", integers, [](auto &pos) { return int32_t(csv::parse_int<'|'>(pos)); },
+                             [](auto &pos) { return csv::Parser<int32_t>().parse_value<'|'>(pos); });
+   equal &= compare<uint64_t>("decimal", decimals,
+                              [](auto &pos) { return std::bit_cast<uint64_t>(csv::parse_double<'|'>(pos)); },
+                              [](auto &pos) { return std::bit_cast<uint64_t>(csv::Parser<double>().parse_value<'|'>(pos)); });
+   equal &= compare<date>("date", dates, [](auto &pos) {
+      auto start = pos.iter;
+      csv::find_either<'|', '\n'>(pos);
+      return stringToType<date>(start, pos.iter - start);
+   }, [](auto &pos) { return csv::Parser<date>().parse_value<'|'>(pos); });
+   return equal ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "../statistics.hpp"
+#include "../types.hpp"
+
+namespace p2c {
+
+// HyperLogLog sketch of the number of distinct values (2^PRECISION one-byte registers, ~0.8% standard error)
+struct HyperLogLog {
+   static constexpr unsigned PRECISION = 14;
+   static constexpr unsigned REGISTERS = 1u << PRECISION;
+
+   std::array<uint8_t, REGISTERS> registers{};
+
+   void add(uint64_t hash) {
+      auto idx = hash >> (64 - PRECISION);
+      // position of the first one bit after the register index (the sentinel bit limits it)
+      uint8_t rank = std::countl_zero((hash << PRECISION) | (1ull << (PRECISION - 1))) + 1;
+      registers[idx] = std::max(registers[idx], rank);
+   }
+
+   double estimate() const {
+      double sum = 0;
+      unsigned zeros = 0;
+      for (auto r : registers) {
+         sum += std::ldexp(1.0, -r);
+         zeros += r == 0;
+      }
+      double m = REGISTERS;
+      double e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+      // linear counting for small cardinalities
+      if (e <= 2.5 * m && zeros)
+         e = m * std::log(m / zeros);
+      return e;
+   }
+};
+
+// collects the statistics of a column (see ColumnStats) while it is imported
+//
+// Row count, nulls, min/max, and distinct values cover all rows; histogram and
+// most common values are computed from a uniform sample of SAMPLE_SIZE rows
+// (reservoir sampling), which holds all rows of small tables.
+template<typename T>
+struct StatsCollector {
+   using stats_t = ColumnStats<T>;
+   using value_t = typename stats_t::value_t;
+
+   static constexpr uint64_t SAMPLE_SIZE = 1ul << 15;
+   static constexpr unsigned HISTOGRAM_BUCKETS = 100;
+   static constexpr unsigned MCV_COUNT = 16;
+
+   uint64_t rows = 0;
+   uint64_t nulls = 0;
+   std::optional<value_t> min, max;
+   HyperLogLog distinct;
+   std::vector<value_t> sample;
+   std::mt19937_64 random{42};
+
+   void add(const T &value) {
+      ++rows;
+      if (!min || value < *min)
+         min = value_t(value);
+      if (!max || *max < value)
+         max = value_t(value);
+      distinct.add(hash(value));
+      auto seen = rows - nulls;
+      if (sample.size() < SAMPLE_SIZE) {
+         sample.emplace_back(value);
+      } else if (auto idx = random() % seen; idx < SAMPLE_SIZE) {
+         sample[idx] = value_t(value);
+      }
+   }
+
+   void add_null() {
+      ++rows;
+      ++nulls;
+   }
+
+   stats_t finish() {
+      stats_t s;
+      s.rows = rows;
+      s.nulls = nulls;
+      if (!min)
+         return s;
+      s.min = *min;
+      s.max = *max;
+      std::sort(sample.begin(), sample.end());
+      auto n = sample.size();
+
+      // distinct values and their counts in the sample
+      std::vector<std::pair<uint64_t, const value_t *>> counts;
+      for (auto i = 0ul; i != n; ++i) {
+         if (i && sample[i] == sample[i - 1]) {
+            ++counts.back().first;
+         } else {
+            counts.emplace_back(1, &sample[i]);
+         }
+      }
+      // the sample is exact if it holds all rows
+      bool exact = n == rows - nulls;
+      s.distinct = exact ? counts.size() : std::clamp<double>(distinct.estimate(), counts.size(), rows - nulls);
+
+      // equi-depth histogram
+      auto buckets = std::min<uint64_t>(HISTOGRAM_BUCKETS, n);
+      for (auto i = 0ul; i <= buckets; ++i) {
+         s.bounds.push_back(sample[i * (n - 1) / buckets]);
+      }
+      s.bounds.front() = s.min;
+      s.bounds.back() = s.max;
+
+      // most common values: all values if there are few, otherwise values that are much more frequent than average
+      std::stable_sort(counts.begin(), counts.end(), [](auto &a, auto &b) { return a.first > b.first; });
+      double average = double(n) / counts.size();
+      double scale = double(rows - nulls) / rows / n;
+      for (auto &[count, value] : counts) {
+         if (s.mcvs.size() == MCV_COUNT || (counts.size() > MCV_COUNT && (count < 2 || count < 1.25 * average)))
+            break;
+         s.mcvs.emplace_back(*value, count * scale);
+      }
+      return s;
+   }
+
+   static uint64_t hash(const T &value) {
+      uint64_t x;
+      if constexpr (std::is_same_v<T, std::string_view>) {
+         x = std::hash<std::string_view>{}(value);
+      } else if constexpr (std::is_same_v<T, date>) {
+         x = uint32_t(value.value);
+      } else if constexpr (std::is_same_v<T, double>) {
+         x = std::bit_cast<uint64_t>(value);
+      } else {
+         x = uint64_t(value);
+      }
+      // finalizer of MurmurHash3, spreads the bits of integers over the register index
+      x ^= x >> 33;
+      x *= 0xff51afd7ed558ccdull;
+      x ^= x >> 33;
+      x *= 0xc4ceb9fe1a85ec53ull;
+      x ^= x >> 33;
+      return x;
+   }
+};
+}  // namespace p2c
@@ -1,13 +1,23 @@
 // Maximilian Kuschewski, 2023
 #pragma once
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <filesystem>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 #include "../io.hpp"
 #include "csv.hpp"
+#include "stats-collector.hpp"
 
 namespace p2c {
 static constexpr char delim = '|';
@@ -15,44 +25,197 @@ static constexpr char delim = '|';
 template<typename T>
 struct ColumnOutput {
    using value_t = T;
-   using page_t = DataColumn<T>;
 
-   uintptr_t output_size;
    std::vector<T> items;
+   // rows (indices into items) whose field was empty
+   std::vector<uint64_t> null_rows;
 
-   ColumnOutput(unsigned expected_rows = 1024)
-       : output_size(page_t::GLOBAL_OVERHEAD), items() {
-      items.reserve(expected_rows);
-   }
+   ColumnOutput(unsigned expected_rows = 1024) : items() { items.reserve(expected_rows); }
 
    ~ColumnOutput() {}
 
    bool append(const T &val) {
       items.push_back(val);
-      if constexpr (page_t::size_tag::IS_VARIABLE) {
-         output_size += val.size() + page_t::PER_ITEM_OVERHEAD;
+      return true;
+   }
+
+   // empty field: stored as zero (empty string), counted as null by the statistics
+   bool append_null() {
+      null_rows.push_back(items.size());
+      if constexpr (std::is_same_v<T, date>) {
+         return append(date(0));
       } else {
-         output_size += sizeof(T);
+         return append(T{});
+      }
+   }
+
+   // drop the values, keep the memory
+   void clear() {
+      items.clear();
+      null_rows.clear();
+   }
+};
+
+// appends the values of a column to its file in chunks of BUFFER_SIZE bytes, so that its memory use does not depend
+// on the size of the column; also collects its zone map and statistics
+//
+// Fixed-size values are appended to the end of the file. Strings use the layout
+// of DataColumn<string_view>: the count, the slot index, which is sized for the
+// row count passed to open (an upper bound, left-over slots stay unused), and
+// the string heap behind it. Slots and heap are buffered separately and
+// written at their own file offsets.
+template<typename T>
+struct ColumnWriter {
+   using page_t = DataColumn<T>;
+   static constexpr bool IS_VARIABLE = page_t::size_tag::IS_VARIABLE;
+   // what is stored per row at the front of the file
+   using item_t = std::conditional_t<IS_VARIABLE, variable_size::StringIndexSlot, T>;
+   static constexpr std::size_t BUFFER_SIZE = 1ul << 18;
+
+   int handle = -1;
+   uint64_t rows = 0;
+   uint64_t max_rows = 0;
+   // values or slots of the rows from item_row on
+   std::vector<item_t> items;
+   uint64_t item_row = 0;
+   // string data starting at file offset heap_offset
+   std::vector<char> heap;
+   uint64_t heap_offset = 0;
+   std::vector<zone_map::Zone<T>> zones;
+   StatsCollector<T> stats;
+
+   ColumnWriter() = default;
+   ColumnWriter(const ColumnWriter &) = delete;
+
+   ~ColumnWriter() {
+      if (handle >= 0) {
+         ::close(handle);
       }
-      return true;
    }
 
-   page_t make_page(const char *filename) const {
-      auto page = page_t(filename, O_CREAT | O_RDWR, output_size);
-      if constexpr (page_t::size_tag::IS_VARIABLE) {
-         auto idx = 0ul;
-         auto offset = page.file_size;
-         char *data = reinterpret_cast<char *>(page.data());
-         for (auto &str : items) {
-            offset -= str.size();
-            std::copy(str.begin(), str.end(), data + offset);
-            page.slot_at(idx++) = {str.size(), offset};
+   void open(const std::string &filename, uint64_t row_limit) {
+      handle = ::open(filename.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+      if (handle < 0) {
+         auto err = errno;
+         throw std::logic_error("Could not open file " + filename + ":" + std::string(strerror(err)));
+      }
+      max_rows = row_limit;
+      items.reserve(BUFFER_SIZE / sizeof(item_t));
+      if constexpr (IS_VARIABLE) {
+         heap_offset = page_t::GLOBAL_OVERHEAD + max_rows * page_t::PER_ITEM_OVERHEAD;
+         heap.reserve(BUFFER_SIZE);
+      }
+   }
+
+   void append(const T &val) {
+      stats.add(val);
+      store(val);
+   }
+
+   void append_null() {
+      stats.add_null();
+      if constexpr (std::is_same_v<T, date>) {
+         store(date(0));
+      } else {
+         store(T{});
+      }
+   }
+
+   // append the rows of a parsed chunk
+   void append(const ColumnOutput<T> &part) {
+      auto null = part.null_rows.begin();
+      for (auto i = 0ul; i != part.items.size(); ++i) {
+         if (null != part.null_rows.end() && *null == i) {
+            append_null();
+            ++null;
+         } else {
+            append(part.items[i]);
          }
-         page.data()->count = idx;
+      }
+   }
+
+   // write the remaining buffers and the row count; then the zone map (fixed-size columns with rows only) and the
+   // statistics
+   void finish(const std::string &zone_file, const std::string &stats_file) {
+      flush();
+      if constexpr (IS_VARIABLE) {
+         uint64_t count = rows;
+         write_at(handle, &count, sizeof(count), 0);
+         if (::ftruncate(handle, heap_offset) < 0) {
+            auto err = errno;
+            throw std::logic_error("Could not resize file: " + std::string(strerror(err)));
+         }
+      } else if (rows) {
+         int zone_handle = ::open(zone_file.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+         if (zone_handle < 0) {
+            auto err = errno;
+            throw std::logic_error("Could not open file " + zone_file + ":" + std::string(strerror(err)));
+         }
+         write_at(zone_handle, zones.data(), zones.size() * sizeof(zones[0]), 0);
+         ::close(zone_handle);
+      }
+      ::close(handle);
+      handle = -1;
+      stats.finish().write(stats_file);
+   }
+
+private:
+   void store(const T &val) {
+      if constexpr (IS_VARIABLE) {
+         if (rows == max_rows) {
+            throw std::logic_error("More rows than announced for string column");
+         }
+         if (heap.size() + val.size() > BUFFER_SIZE) {
+            flush_heap();
+         }
+         items.push_back({val.size(), heap_offset + heap.size()});
+         heap.insert(heap.end(), val.begin(), val.end());
       } else {
-         std::copy(items.begin(), items.end(), page.begin());
+         if (rows % zone_map::BLOCK_ROWS == 0) {
+            zones.push_back({val, val});
+         } else {
+            zones.back().min = std::min(zones.back().min, val);
+            zones.back().max = std::max(zones.back().max, val);
+         }
+         items.push_back(val);
+      }
+      if (items.size() == items.capacity()) {
+         flush_items();
+      }
+      ++rows;
+   }
+
+   void flush() {
+      flush_items();
+      if constexpr (IS_VARIABLE) {
+         flush_heap();
+      }
+   }
+
+   void flush_items() {
+      write_at(handle, items.data(), items.size() * sizeof(item_t), page_t::GLOBAL_OVERHEAD + item_row * sizeof(item_t));
+      item_row += items.size();
+      items.clear();
+   }
+
+   void flush_heap() {
+      write_at(handle, heap.data(), heap.size(), heap_offset);
+      heap_offset += heap.size();
+      heap.clear();
+   }
+
+   static void write_at(int fd, const void *data, std::size_t size, uint64_t offset) {
+      auto bytes = static_cast<const char *>(data);
+      while (size) {
+         auto written = ::pwrite(fd, bytes, size, offset);
+         if (written < 0) {
+            auto err = errno;
+            throw std::logic_error("Could not write file: " + std::string(strerror(err)));
+         }
+         bytes += written;
+         size -= written;
+         offset += written;
       }
-      return page;
    }
 };
 
@@ -61,11 +224,12 @@ struct TableImport {
    using tuple_type = std::tuple<Ts...>;
    using outputs_t = std::tuple<ColumnOutput<Ts>...>;
 
-   outputs_t outputs;
+   // parsed columns of each chunk of the input, in input order
+   std::vector<outputs_t> chunks;
    std::vector<FileMapping<char>> inputs;
 
    TableImport(const char *filename)
-       : outputs(), inputs(open(filename)) {}
+       : chunks(1), inputs(open(filename)) {}
 
    ~TableImport() {}
 
@@ -91,40 +255,126 @@ struct TableImport {
       return result;
    }
 
-   unsigned read() {
-      std::vector<unsigned> columns(sizeof...(Ts));
-      for (auto i = 0u; i != sizeof...(Ts); ++i) {
-         columns[i] = i;
-      }
-      unsigned rows = 0;
+   // input bytes per chunk, which bounds the memory of the parsed values of a chunk
+   static constexpr std::size_t CHUNK_SIZE = 32ul << 20;
+
+   // parse all input files: every file is split into chunks of whole lines (at most about CHUNK_SIZE bytes, at least
+   // one per thread), and thread_count chunks at a time are parsed in parallel, each into its own column outputs.
+   // Without consumer, all chunks are kept. Otherwise, consume(chunks) is called with the chunks of every round in
+   // input order, which are dropped afterwards (together with the input pages they were parsed from)
+   template<typename Consumer = std::nullptr_t>
+   unsigned read(unsigned thread_count = 1, const Consumer &consume = nullptr) {
+      constexpr bool streaming = !std::is_same_v<Consumer, std::nullptr_t>;
+      thread_count = std::max(thread_count, 1u);
+      std::vector<csv::CharIter> ranges;
       for (auto &input : inputs) {
-         rows += csv::read_file<delim>(input, columns, [&](unsigned col, csv::CharIter &pos) {
-            fold_outputs(0, [&](auto &output, unsigned idx, unsigned num, unsigned v) {
-               if (idx == col) {
-                  using value_t = typename std::remove_reference<decltype(output)>::type::value_t;
-                  csv::Parser<value_t> parser;
-                  auto value = parser.template parse_value<delim>(pos);
-                  output.append(value);
-               }
-               return 0;
-            });
-         });
+         auto pieces = std::max<std::size_t>(thread_count, (input.file_size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+         for (auto &range : csv::split_lines(input, pieces)) {
+            ranges.push_back(range);
+         }
       }
+      chunks.clear();
+      chunks.resize(streaming ? 0 : std::max<size_t>(ranges.size(), 1));
 
-      return rows;
+      unsigned total = 0;
+      for (auto first = 0ul; first < ranges.size(); first += thread_count) {
+         auto count = std::min<size_t>(thread_count, ranges.size() - first);
+         auto base = streaming ? first : 0;
+         if constexpr (streaming) {
+            // reuse the outputs of the previous round
+            chunks.resize(count);
+            for (auto &chunk : chunks) {
+               fold_outputs(chunk, 0, [](auto &output, unsigned, unsigned, unsigned v) {
+                  output.clear();
+                  return v;
+               });
+            }
+         }
+         std::vector<unsigned> rows(count);
+         csv::parallel_exec([&](unsigned thread_id, unsigned) {
+            rows[thread_id] = parse(ranges[first + thread_id], chunks[first + thread_id - base]);
+         }, count);
+         for (auto r : rows) {
+            total += r;
+         }
+         if constexpr (streaming) {
+            consume(chunks);
+            for (auto c = first; c != first + count; ++c) {
+               release(ranges[c]);
+            }
+         }
+      }
+      if constexpr (streaming) {
+         chunks.clear();
+         chunks.resize(1);
+      }
+      return total;
    }
    unsigned operator()() { return read(); }
 
    constexpr static unsigned column_count() { return std::tuple_size_v<outputs_t>; }
 
-   size_t row_count() { return std::get<0>(outputs).items.size(); }
+   size_t row_count() {
+      size_t rows = 0;
+      for (auto &chunk : chunks) {
+         rows += std::get<0>(chunk).items.size();
+      }
+      return rows;
+   }
+
+   // parse the lines of range into outputs, returns the number of rows
+   static unsigned parse(const csv::CharIter &range, outputs_t &outputs) {
+      static const std::vector<unsigned> columns = [] {
+         std::vector<unsigned> result(sizeof...(Ts));
+         for (auto i = 0u; i != sizeof...(Ts); ++i) {
+            result[i] = i;
+         }
+         return result;
+      }();
+      return csv::read_chunk<delim>(range, columns, [&](unsigned col, csv::CharIter &pos) {
+         fold_outputs(outputs, 0, [&](auto &output, unsigned idx, unsigned num, unsigned v) {
+            if (idx == col) {
+               using value_t = typename std::remove_reference<decltype(output)>::type::value_t;
+               if (pos.iter == pos.limit || *pos.iter == delim || *pos.iter == '\n') {
+                  output.append_null();
+                  return 0;
+               }
+               csv::Parser<value_t> parser;
+               auto value = parser.template parse_value<delim>(pos);
+               output.append(value);
+            }
+            return 0;
+         });
+      });
+   }
+
+   // drop the pages of a parsed range of the input from memory (they are read from the file again if accessed)
+   static void release(const csv::CharIter &range) {
+      static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+      auto begin = reinterpret_cast<uintptr_t>(range.iter) & ~(page_size - 1);
+      ::madvise(reinterpret_cast<void *>(begin), reinterpret_cast<uintptr_t>(range.limit) - begin, MADV_DONTNEED);
+   }
 
    template<typename T, typename F, unsigned I = 0>
-   constexpr T fold_outputs(T init_value, const F &fn) {
+   constexpr static T fold_outputs(outputs_t &outputs, T init_value, const F &fn) {
       if constexpr (I == sizeof...(Ts)) {
          return init_value;
       } else {
-         return fold_outputs<T, F, I + 1>(fn(std::get<I>(outputs), I, sizeof...(Ts), init_value), fn);
+         return fold_outputs<T, F, I + 1>(outputs, fn(std::get<I>(outputs), I, sizeof...(Ts), init_value), fn);
+      }
+   }
+
+   // call fn(parts, idx) for every column with its outputs of the given chunks, in input order; idx is a
+   // std::integral_constant (usable as template argument)
+   template<typename F, unsigned I = 0>
+   static void fold_columns(const std::vector<outputs_t> &chunks, const F &fn) {
+      if constexpr (I != sizeof...(Ts)) {
+         std::vector<const std::tuple_element_t<I, outputs_t> *> parts;
+         for (auto &chunk : chunks) {
+            parts.push_back(&std::get<I>(chunk));
+         }
+         fn(parts, std::integral_constant<unsigned, I>{});
+         fold_columns<F, I + 1>(chunks, fn);
       }
    }
 };  // struct TableImport
@@ -132,28 +382,54 @@ struct TableImport {
 template<typename... Ts>
 struct TableReader : TableImport<Ts...> {
    using super_t = TableImport<Ts...>;
+   using outputs_t = typename super_t::outputs_t;
    std::array<std::string, sizeof...(Ts)> output_files;
+   std::array<std::string, sizeof...(Ts)> zone_files;
+   std::array<std::string, sizeof...(Ts)> stats_files;
+   std::tuple<ColumnWriter<Ts>...> writers;
 
    TableReader(const std::string &output_prefix, const char *filename, char const *const *colnames)
        : super_t(filename) {
       // initialize output files
       std::filesystem::create_directories(output_prefix);
-      this->fold_outputs(0, [&](const auto &output, unsigned idx, unsigned num, unsigned v) {
+      for (auto idx = 0u; idx != super_t::column_count(); ++idx) {
          output_files[idx] = output_prefix + colnames[idx] + ".bin";
-         return 0;
-      });
+         zone_files[idx] = output_prefix + colnames[idx] + ".zones";
+         stats_files[idx] = output_prefix + colnames[idx] + ".stats";
+      }
    }
 
-   ~TableReader() {
-      // write to files
-      this->fold_outputs(0, [&](const auto &output, unsigned idx, unsigned num, unsigned v) {
-         auto page = output.make_page(output_files[idx].c_str());
-         page.flush();
-         // for (auto item : page) {
-         //   std::cout << "idx " << idx << " item " << item << std::endl;
-         // }
-         return 0;
+   // parse the input with thread_count threads and stream the parsed chunks to the column files, which are written in
+   // parallel (one column per thread at a time)
+   unsigned read(unsigned threads = 1) {
+      uint64_t lines = 0;
+      for (auto &input : this->inputs) {
+         lines += csv::count_lines(input);
+      }
+      auto column_threads = std::clamp(threads, 1u, super_t::column_count());
+      auto for_columns = [&](const std::vector<outputs_t> &chunks, const auto &fn) {
+         csv::parallel_exec([&](unsigned thread_id, unsigned n) {
+            super_t::fold_columns(chunks, [&](const auto &parts, auto idx) {
+               if (idx % n == thread_id) {
+                  fn(std::get<decltype(idx)::value>(writers), parts, idx);
+               }
+            });
+         }, column_threads);
+      };
+      // no chunks: visits every column once with no parts
+      const std::vector<outputs_t> none;
+      for_columns(none, [&](auto &writer, const auto &, unsigned idx) { writer.open(output_files[idx], lines); });
+      auto rows = super_t::read(threads, [&](const std::vector<outputs_t> &chunks) {
+         for_columns(chunks, [&](auto &writer, const auto &parts, unsigned) {
+            for (auto *part : parts) {
+               writer.append(*part);
+            }
+         });
       });
+      for_columns(none, [&](auto &writer, const auto &, unsigned idx) {
+         writer.finish(zone_files[idx], stats_files[idx]);
+      });
+      return rows;
    }
 };  // struct TableReader
 }  // namespace p2c
@@ -1,6 +1,7 @@
 // Maximilian Kuschewski, 2023
 // Adapted from Spilly
 #pragma once
+#include <cstring>
 #include <string_view>
 
 #include "../types.hpp"
@@ -25,6 +26,55 @@ struct Parser<T> {
       return stringToType<T>(start, pos.iter - start);
    }
 };
+
+// date::toInt of the years 1900 to 2155 by table lookups: the first day of each year, starting in March so leap days
+// come last, and the offset of the months within it
+struct DateTable {
+   static constexpr unsigned FIRST_YEAR = 1900, YEARS = 256;
+   uint32_t years[YEARS];
+   uint16_t months[13];
+
+   constexpr DateTable() : years(), months() {
+      for (unsigned y = 0; y != YEARS; y++)
+         years[y] = date::toInt(FIRST_YEAR + y, 3, 1);
+      for (unsigned m = 1; m != 13; m++)
+         months[m] = date::toInt(2001, m, 1) - date::toInt(2001 - (m < 3), 3, 1);
+   }
+};
+inline constexpr DateTable DATE_TABLE;
+
+template<>
+struct Parser<date> {
+   static constexpr char const *TYPE_NAME = TYPE_NAMES[tindex(type_tag<date>::tag)];
+
+   // YYYY-MM-DD: the digits are gathered into one chunk YYYYMMDD and combined pairwise (SWAR), which yields the two
+   // halves of the year, the month and the day; the format is checked with a single branch. The date is looked up in
+   // DATE_TABLE, dates outside of it and other formats go through stringToType
+   template<char delim, char eol = '\n'>
+   inline date parse_value(CharIter &pos) {
+      auto start = pos.iter;
+      if (pos.limit - start >= 16) {
+         auto chunk = load_chunk(start), tail = load_chunk(start + 8);
+         char end = tail >> 16;
+         auto digits = (chunk & 0xFFFFFFFFull) | ((chunk >> 40 & 0xFFFF) << 32) | (tail << 48);
+         auto pairs = digits - ASCII_ZEROS;
+         pairs = pairs * 10 + (pairs >> 8);
+         unsigned year = (pairs & 0xFF) * 100 + (pairs >> 16 & 0xFF), month = pairs >> 32 & 0xFF, day = pairs >> 48 & 0xFF;
+         unsigned table_year = year - (month < 3) - DateTable::FIRST_YEAR;
+         constexpr uint64_t separators = uint64_t('-') << 32 | uint64_t('-') << 56;
+         bool valid = ((chunk & 0xFF0000FF00000000ull) == separators) & ((end == delim) | (end == eol)) &
+                      (swar_digit_count(digits) == 8) & (month - 1 < 12) & (day - 1 < 31) &
+                      (table_year < DateTable::YEARS);
+         if (valid) {
+            pos.iter += 10;
+            return date(int32_t(DATE_TABLE.years[table_year] + DATE_TABLE.months[month] + day - 1));
+         }
+      }
+      find_either<delim, eol>(pos);
+      assert(pos.iter != nullptr && (*pos.iter == delim || *pos.iter == eol));
+      return stringToType<date>(start, pos.iter - start);
+   }
+};
 }  // namespace csv
 // ------------------------------------------------------------------------------
 
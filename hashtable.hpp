@@ -0,0 +1,595 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "parallel.hpp"
+#include "types.hpp"
+
+namespace p2c {
+
+////////////////////////////////////////////////////////////////////////////////
+// Hashing
+
+// murmur3 finalizer: every input bit affects every output bit
+inline uint64_t hashMix(uint64_t k) {
+   k ^= k >> 33;
+   k *= 0xff51afd7ed558ccdull;
+   k ^= k >> 33;
+   k *= 0xc4ceb9fe1a85ec53ull;
+   k ^= k >> 33;
+   return k;
+}
+
+inline uint64_t hashValue(int32_t v) { return static_cast<uint32_t>(v); }
+inline uint64_t hashValue(int64_t v) { return static_cast<uint64_t>(v); }
+inline uint64_t hashValue(char v) { return static_cast<unsigned char>(v); }
+inline uint64_t hashValue(bool v) { return v; }
+inline uint64_t hashValue(double v) { return std::bit_cast<uint64_t>(v); }
+inline uint64_t hashValue(date v) { return static_cast<uint32_t>(v.value); }
+inline uint64_t hashValue(std::string_view v) { return std::hash<std::string_view>()(v); }
+
+// hash a (multi-attribute) key
+template<typename... Ts>
+inline uint64_t hashKey(const std::tuple<Ts...>& key) {
+   uint64_t h = 0;
+   std::apply([&](const auto&... v) { ((h = hashMix(h ^ hashValue(v))), ...); }, key);
+   return h;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Bloom Filter
+
+// register-blocked Bloom filter: all bits of a key are in one 64-bit word
+//
+// Used for sideways information passing from a join's build side to the
+// scan of its probe side. Scans report how many tuples they checked and
+// rejected; once enough tuples have been checked, a filter that rejects
+// too few of them disables itself.
+class BloomFilter {
+   std::vector<uint64_t> words{0};
+   uint64_t mask = 0;
+   std::atomic<uint64_t> checked{0}, rejected{0};
+   std::atomic<bool> enabled{true};
+
+   static uint64_t pattern(uint64_t hash) {
+      return (1ull << ((hash >> 40) & 63)) | (1ull << ((hash >> 46) & 63)) | (1ull << ((hash >> 52) & 63)) | (1ull << ((hash >> 58) & 63));
+   }
+
+public:
+   static constexpr uint64_t bitsPerKey = 16;
+   static constexpr uint64_t minChecks = 1ull << 16;
+   // disable filter if it rejects less than 1/minRejectRatio of the checked tuples
+   static constexpr uint64_t minRejectRatio = 4;
+
+   // size filter for the expected number of keys
+   void init(uint64_t keyCount) {
+      words.assign(std::bit_ceil(std::max<uint64_t>(keyCount * bitsPerKey / 64, 1)), 0);
+      mask = words.size() - 1;
+   }
+
+   // thread-safe insert
+   void insert(uint64_t hash) { std::atomic_ref<uint64_t>(words[hash & mask]).fetch_or(pattern(hash), std::memory_order_relaxed); }
+
+   bool mayContain(uint64_t hash) const {
+      uint64_t p = pattern(hash);
+      return (words[hash & mask] & p) == p;
+   }
+
+   bool active() const { return enabled.load(std::memory_order_relaxed); }
+
+   // account a morsel's statistics, disables filter if it filters poorly
+   void report(uint64_t morselChecked, uint64_t morselRejected) {
+      uint64_t c = checked.fetch_add(morselChecked, std::memory_order_relaxed) + morselChecked;
+      uint64_t r = rejected.fetch_add(morselRejected, std::memory_order_relaxed) + morselRejected;
+      if (c >= minChecks && r * minRejectRatio < c)
+         enabled.store(false, std::memory_order_relaxed);
+   }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Join Hash Table
+
+// hash table for the build side of hash joins
+//
+// Tuples are first appended to thread-local buffers. Once the build side is
+// complete, finalize() sizes the directory from the build cardinality and
+// scatters all entries such that the entries of each bucket (including
+// duplicate keys) are stored contiguously. Each directory slot holds the end
+// offset of its bucket's chain and 16 tag bits that reject most misses
+// without touching the entries.
+template<typename Key, typename Payload>
+class JoinHashTable {
+public:
+   struct Entry {
+      uint64_t hash;
+      Key key;
+      Payload payload;
+   };
+
+   // iterates over the entries with a matching key
+   struct Range {
+      const Entry* first;
+      const Entry* last;
+      uint64_t hash;
+      Key key;
+
+      struct iterator {
+         const Entry* it;
+         const Range* range;
+         void skip() {
+            while (it != range->last && (it->hash != range->hash || it->key != range->key))
+               ++it;
+         }
+         const Entry& operator*() const { return *it; }
+         iterator& operator++() {
+            ++it;
+            skip();
+            return *this;
+         }
+         bool operator!=(const iterator& rhs) const { return it != rhs.it; }
+      };
+
+      iterator begin() const {
+         iterator i{first, this};
+         i.skip();
+         return i;
+      }
+      iterator end() const { return {last, this}; }
+   };
+
+private:
+   static constexpr uint64_t offsetMask = (1ull << 48) - 1;
+
+   PerWorker<std::vector<Entry>> buffers;
+   std::vector<Entry> entries;
+   // slot b+1 holds the end offset of bucket b, slot 0 is always 0
+   std::vector<uint64_t> directory;
+   uint64_t mask = 0;
+
+   static uint64_t tag(uint64_t hash) { return 1ull << (48 + (hash >> 60)); }
+
+   // call fn on all buffered entries in parallel
+   template<typename Fn>
+   void forEachBuffered(ThreadPool& pool, Fn fn) {
+      std::vector<uint64_t> prefix{0};
+      for (auto& buffer : buffers)
+         prefix.push_back(prefix.back() + buffer.size());
+      pool.parallelFor(prefix.back(), [&](uint64_t begin, uint64_t end) {
+         unsigned b = std::upper_bound(prefix.begin(), prefix.end(), begin) - prefix.begin() - 1;
+         for (uint64_t i = begin; i != end; i++) {
+            while (i == prefix[b + 1])
+               b++;
+            fn(buffers[b][i - prefix[b]]);
+         }
+      });
+   }
+
+public:
+   // expectedTuples (if known) is the estimated build cardinality, the buffers reserve capacity for an even share of it
+   explicit JoinHashTable(unsigned workerCount, uint64_t expectedTuples = 0) : buffers(workerCount), directory(2, 0) {
+      if (expectedTuples)
+         for (auto& buffer : buffers)
+            buffer.reserve(expectedTuples / workerCount + 1);
+   }
+
+   // add tuple to the buffer of the calling worker
+   void insert(const Key& key, const Payload& payload) { buffers.local().push_back({hashKey(key), key, payload}); }
+
+   // build Bloom filter over the inserted keys (before finalize)
+   void buildFilter(ThreadPool& pool, BloomFilter& filter) {
+      filter.init(bufferedSize());
+      forEachBuffered(pool, [&](const Entry& e) { filter.insert(e.hash); });
+   }
+
+   // build directory after all tuples have been inserted
+   void finalize(ThreadPool& pool) {
+      uint64_t count = 0;
+      for (auto& buffer : buffers)
+         count += buffer.size();
+      uint64_t bucketCount = std::bit_ceil(std::max<uint64_t>(count * 2, 1));
+      mask = bucketCount - 1;
+      directory.assign(bucketCount + 1, 0);
+      entries.resize(count);
+
+      // count entries per bucket and set tag bits
+      forEachBuffered(pool, [&](const Entry& e) {
+         std::atomic_ref<uint64_t> slot(directory[(e.hash & mask) + 1]);
+         slot.fetch_add(1, std::memory_order_relaxed);
+         slot.fetch_or(tag(e.hash), std::memory_order_relaxed);
+      });
+      // compute start offsets of buckets
+      uint64_t offset = 0;
+      for (uint64_t b = 1; b != bucketCount + 1; b++) {
+         uint64_t size = directory[b] & offsetMask;
+         directory[b] = (directory[b] & ~offsetMask) | offset;
+         offset += size;
+      }
+      // scatter entries; afterwards slot b+1 contains the end offset of bucket b
+      forEachBuffered(pool, [&](const Entry& e) {
+         std::atomic_ref<uint64_t> slot(directory[(e.hash & mask) + 1]);
+         entries[slot.fetch_add(1, std::memory_order_relaxed) & offsetMask] = e;
+      });
+      for (auto& buffer : buffers)
+         std::vector<Entry>().swap(buffer);
+   }
+
+   // prefetch directory slot of a hash (for batched probes)
+   void prefetch(uint64_t hash) const { __builtin_prefetch(&directory[(hash & mask) + 1]); }
+
+   // find all entries with the given key
+   Range equal_range(const Key& key) const { return equal_range(key, hashKey(key)); }
+   Range equal_range(const Key& key, uint64_t hash) const {
+      uint64_t b = hash & mask;
+      uint64_t slot = directory[b + 1];
+      if (!(slot & tag(hash)))
+         return {nullptr, nullptr, hash, key};
+      return {entries.data() + (directory[b] & offsetMask), entries.data() + (slot & offsetMask), hash, key};
+   }
+
+   uint64_t size() const { return entries.size(); }
+
+   // number of inserted tuples (before finalize)
+   uint64_t bufferedSize() {
+      uint64_t count = 0;
+      for (auto& buffer : buffers)
+         count += buffer.size();
+      return count;
+   }
+
+   // thread-local buffers with the inserted tuples (before finalize)
+   PerWorker<std::vector<Entry>>& buffered() { return buffers; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Radix Join
+
+// partition index of a hash using its topmost bits
+inline uint64_t radixPartition(uint64_t hash, unsigned bits) {
+   return bits ? hash >> (64 - bits) : 0;
+}
+
+// radix partitioning of thread-local buffers (elements need a hash member)
+// into one contiguous array, using one pass for up to 2^maxPassBits
+// partitions and two passes otherwise (to limit TLB misses)
+template<typename T>
+struct RadixPartitioning {
+   static constexpr unsigned maxPassBits = 8;
+
+   std::vector<T> data;
+   // partition p is data[offsets[p], offsets[p+1])
+   std::vector<uint64_t> offsets;
+
+   void run(ThreadPool& pool, PerWorker<std::vector<T>>& in, unsigned bits) {
+      unsigned bits1 = std::min(bits, maxPassBits), bits2 = bits - bits1;
+      uint64_t fanout1 = 1ull << bits1, fanout2 = 1ull << bits2;
+
+      // first pass: histogram per thread-local buffer, then scatter
+      std::vector<std::vector<uint64_t>> hist(in.size(), std::vector<uint64_t>(fanout1));
+      pool.parallelFor(in.size(), [&](uint64_t begin, uint64_t end) {
+         for (uint64_t w = begin; w != end; w++)
+            for (auto& t : in[w])
+               hist[w][radixPartition(t.hash, bits1)]++;
+      }, 1);
+      std::vector<uint64_t> offsets1(fanout1 + 1);
+      uint64_t offset = 0;
+      for (uint64_t p = 0; p != fanout1; p++) {
+         offsets1[p] = offset;
+         for (auto& h : hist) {
+            uint64_t count = h[p];
+            h[p] = offset;
+            offset += count;
+         }
+      }
+      offsets1[fanout1] = offset;
+      data.resize(offset);
+      pool.parallelFor(in.size(), [&](uint64_t begin, uint64_t end) {
+         for (uint64_t w = begin; w != end; w++) {
+            for (auto& t : in[w])
+               data[hist[w][radixPartition(t.hash, bits1)]++] = t;
+            std::vector<T>().swap(in[w]);
+         }
+      }, 1);
+      if (!bits2) {
+         offsets = std::move(offsets1);
+         return;
+      }
+
+      // second pass: split each partition independently
+      std::vector<T> out(data.size());
+      offsets.assign((fanout1 << bits2) + 1, 0);
+      offsets.back() = data.size();
+      pool.parallelFor(fanout1, [&](uint64_t begin, uint64_t end) {
+         for (uint64_t p1 = begin; p1 != end; p1++) {
+            std::vector<uint64_t> pos(fanout2);
+            for (uint64_t i = offsets1[p1]; i != offsets1[p1 + 1]; i++)
+               pos[radixPartition(data[i].hash, bits) & (fanout2 - 1)]++;
+            uint64_t offset = offsets1[p1];
+            for (uint64_t p2 = 0; p2 != fanout2; p2++) {
+               offsets[(p1 << bits2) | p2] = offset;
+               uint64_t count = pos[p2];
+               pos[p2] = offset;
+               offset += count;
+            }
+            for (uint64_t i = offsets1[p1]; i != offsets1[p1 + 1]; i++)
+               out[pos[radixPartition(data[i].hash, bits) & (fanout2 - 1)]++] = data[i];
+         }
+      }, 1);
+      data.swap(out);
+   }
+};
+
+// radix-partitioned hash join for build sides that exceed the cache
+//
+// Both inputs are materialized and partitioned on the same hash bits such
+// that the hash table of each build partition fits into the L2 cache. Then
+// each pair of partitions is joined by one worker.
+template<typename Key, typename Payload, typename Values>
+class RadixJoin {
+public:
+   using BuildEntry = typename JoinHashTable<Key, Payload>::Entry;
+   struct ProbeEntry {
+      uint64_t hash;
+      Key key;
+      Values values;
+   };
+   static constexpr uint64_t cacheBudget = 256 * 1024;
+   static constexpr unsigned maxBits = 16;
+
+private:
+   PerWorker<std::vector<ProbeEntry>> buffers;
+
+public:
+   explicit RadixJoin(unsigned workerCount) : buffers(workerCount) {}
+
+   // buffer probe tuple of the calling worker
+   void insert(const Key& key, const Values& values) { buffers.local().push_back({hashKey(key), key, values}); }
+
+   // join buffered probe tuples with the (not finalized) build side, calls fn(buildEntry, probeEntry) for every match
+   template<typename Fn>
+   void join(ThreadPool& pool, JoinHashTable<Key, Payload>& build, Fn fn) {
+      uint64_t partitionCount = (build.bufferedSize() * sizeof(BuildEntry) + cacheBudget - 1) / cacheBudget;
+      unsigned bits = std::min<unsigned>(std::bit_width(std::max<uint64_t>(partitionCount, 1) - 1), maxBits);
+      RadixPartitioning<BuildEntry> buildPartitions;
+      RadixPartitioning<ProbeEntry> probePartitions;
+      buildPartitions.run(pool, build.buffered(), bits);
+      probePartitions.run(pool, buffers, bits);
+
+      pool.parallelFor(1ull << bits, [&](uint64_t begin, uint64_t end) {
+         std::vector<uint32_t> heads, next;
+         for (uint64_t p = begin; p != end; p++) {
+            const BuildEntry* b = buildPartitions.data.data() + buildPartitions.offsets[p];
+            uint64_t buildCount = buildPartitions.offsets[p + 1] - buildPartitions.offsets[p];
+            uint64_t probeBegin = probePartitions.offsets[p], probeEnd = probePartitions.offsets[p + 1];
+            if (!buildCount || probeBegin == probeEnd)
+               continue;
+            // chained hash table over the build partition
+            uint64_t mask = std::bit_ceil(buildCount) - 1;
+            heads.assign(mask + 1, 0);
+            next.resize(buildCount);
+            for (uint64_t i = 0; i != buildCount; i++) {
+               uint64_t slot = b[i].hash & mask;
+               next[i] = heads[slot];
+               heads[slot] = i + 1;
+            }
+            // probe
+            for (uint64_t j = probeBegin; j != probeEnd; j++) {
+               const ProbeEntry& probe = probePartitions.data[j];
+               for (uint32_t i = heads[probe.hash & mask]; i; i = next[i - 1])
+                  if (b[i - 1].hash == probe.hash && b[i - 1].key == probe.key)
+                     fn(b[i - 1], probe);
+            }
+         }
+      }, 1);
+   }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Aggregation Hash Table
+
+// hash table for group by
+//
+// Groups (key and aggregates) are stored densely in insertion order, so
+// aggregates are updated in place and the table can be scanned like an
+// array. Lookups use linear probing over a separate power-of-two slot array
+// whose slots hold the upper hash bits (as tag) and the group's index. When
+// the table becomes half full, only the slot array is rebuilt from the stored
+// hashes; keys and aggregates are not rehashed.
+template<typename Key, typename Value>
+class AggregationHashTable {
+public:
+   struct Entry {
+      uint64_t hash;
+      Key key;
+      Value value;
+   };
+
+private:
+   static constexpr uint64_t indexMask = (1ull << 32) - 1;
+
+   std::vector<Entry> entries;
+   // 0 is empty, otherwise (hash & ~indexMask) | (index + 1)
+   std::vector<uint64_t> slots;
+   uint64_t mask;
+
+   void grow() {
+      slots.assign(slots.size() * 2, 0);
+      mask = slots.size() - 1;
+      for (uint64_t i = 0; i != entries.size(); i++) {
+         uint64_t pos = entries[i].hash & mask;
+         while (slots[pos])
+            pos = (pos + 1) & mask;
+         slots[pos] = (entries[i].hash & ~indexMask) | (i + 1);
+      }
+   }
+
+public:
+   explicit AggregationHashTable(uint64_t expectedGroups = 64)
+       : slots(std::bit_ceil(std::max<uint64_t>(expectedGroups * 2, 16)), 0), mask(slots.size() - 1) {
+      entries.reserve(expectedGroups);
+   }
+
+   // find group of key or insert it; the aggregates of a new group are default constructed
+   std::pair<Value&, bool> findOrInsert(const Key& key, uint64_t hash) {
+      uint64_t pos = hash & mask;
+      while (uint64_t slot = slots[pos]) {
+         if ((slot & ~indexMask) == (hash & ~indexMask)) {
+            Entry& e = entries[(slot & indexMask) - 1];
+            if (e.key == key)
+               return {e.value, false};
+         }
+         pos = (pos + 1) & mask;
+      }
+      slots[pos] = (hash & ~indexMask) | (entries.size() + 1);
+      entries.push_back({hash, key, Value()});
+      Value& value = entries.back().value;
+      if (entries.size() * 2 > slots.size())
+         grow();
+      return {value, true};
+   }
+   std::pair<Value&, bool> findOrInsert(const Key& key) { return findOrInsert(key, hashKey(key)); }
+
+   // remove all groups but keep the allocated memory
+   void clear() {
+      entries.clear();
+      std::fill(slots.begin(), slots.end(), 0);
+   }
+
+   uint64_t size() const { return entries.size(); }
+   Entry& operator[](uint64_t idx) { return entries[idx]; }
+   auto begin() { return entries.begin(); }
+   auto end() { return entries.end(); }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Parallel Aggregation
+
+// two-phase parallel group by
+//
+// Phase 1: every worker pre-aggregates into a small, cache-resident
+// thread-local table. When the table is full, its groups are spilled into
+// thread-local hash partitions and the table is reused.
+// Phase 2 (merge): each partition is aggregated by a single worker into its
+// own table, so no synchronization is needed. If no worker ever spilled and
+// there are few groups (low cardinality), the thread-local tables are merged
+// directly instead.
+template<typename Key, typename Value>
+class ParallelAggregation {
+public:
+   using Table = AggregationHashTable<Key, Value>;
+   using Entry = typename Table::Entry;
+   static constexpr unsigned partitionBits = 6;
+   static constexpr uint64_t partitionCount = 1ull << partitionBits;
+   static constexpr uint64_t localCapacity = 1ull << 12;
+
+private:
+   struct Local {
+      Table table{localCapacity};
+      std::vector<std::vector<Entry>> partitions{partitionCount};
+      bool spilled = false;
+   };
+
+   PerWorker<Local> locals;
+   std::vector<Table> results;
+   // expected number of groups (0 if unknown), the partitions' tables are sized for an even share of them
+   uint64_t expectedGroups;
+
+   static void spill(Local& local) {
+      for (auto& e : local.table)
+         local.partitions[e.hash >> (64 - partitionBits)].push_back(e);
+      local.table.clear();
+      local.spilled = true;
+   }
+
+   // shrink the table of partition p to the tuples the workers pre-aggregated for it if they are fewer than the
+   // expected groups (before merge); without an estimate the table grows as needed, as the tuples are a loose upper
+   // bound of the groups (a group is spilled again by every flush of the thread-local table)
+   void fit(uint64_t p, uint64_t tuples, uint64_t expected) {
+      uint64_t size = std::max<uint64_t>(std::min(tuples, expected), 64);
+      if (expectedGroups && size != std::max<uint64_t>(expectedGroups / partitionCount, 64))
+         results[p] = Table(size);
+   }
+
+public:
+   // expectedGroups (if known) is the expected number of groups (observed in earlier runs or estimated), the
+   // partitions' tables are sized for an even share of them and shrunk in merge if fewer tuples arrive
+   explicit ParallelAggregation(unsigned workerCount, uint64_t expectedGroups = 0)
+       : locals(workerCount), expectedGroups(expectedGroups) {
+      // construct in place, copies of a table do not keep its reserved capacity
+      results.reserve(partitionCount);
+      for (uint64_t p = 0; p != partitionCount; p++)
+         results.emplace_back(std::max<uint64_t>(expectedGroups / partitionCount, 64));
+   }
+
+   // find or insert group in the thread-local table of the calling worker
+   std::pair<Value&, bool> findOrInsert(const Key& key) {
+      Local& local = locals.local();
+      if (local.table.size() == localCapacity)
+         spill(local);
+      return local.table.findOrInsert(key);
+   }
+
+   // combine all partial aggregates; mergeFn(Value& aggs, const Value& other) merges two groups
+   template<typename MergeFn>
+   void merge(ThreadPool& pool, MergeFn mergeFn) {
+      auto add = [&](Table& table, const Entry& e) {
+         auto [aggs, isNew] = table.findOrInsert(e.key, e.hash);
+         if (isNew)
+            aggs = e.value;
+         else
+            mergeFn(aggs, e.value);
+      };
+
+      uint64_t groups = 0;
+      bool spilled = false;
+      for (auto& local : locals) {
+         groups += local.table.size();
+         spilled |= local.spilled;
+      }
+      if (!spilled && groups <= localCapacity) {
+         // low cardinality: merge thread-local tables directly
+         fit(0, groups, expectedGroups);
+         for (auto& local : locals)
+            for (auto& e : local.table)
+               add(results[0], e);
+         return;
+      }
+
+      pool.parallelFor(locals.size(), [&](uint64_t begin, uint64_t end) {
+         for (uint64_t w = begin; w != end; w++)
+            spill(locals[w]);
+      }, 1);
+      pool.parallelFor(partitionCount, [&](uint64_t begin, uint64_t end) {
+         for (uint64_t p = begin; p != end; p++) {
+            uint64_t tuples = 0;
+            for (auto& local : locals)
+               tuples += local.partitions[p].size();
+            fit(p, tuples, expectedGroups / partitionCount);
+            for (auto& local : locals) {
+               for (auto& e : local.partitions[p])
+                  add(results[p], e);
+               std::vector<Entry>().swap(local.partitions[p]);
+            }
+         }
+      }, 1);
+   }
+
+   // result groups of partition p (after merge)
+   Table& partition(uint64_t p) { return results[p]; }
+
+   // number of groups (after merge)
+   uint64_t groupCount() const {
+      uint64_t count = 0;
+      for (auto& table : results)
+         count += table.size();
+      return count;
+   }
+};
+
+}  // namespace p2c
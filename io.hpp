@@ -121,6 +121,22 @@ struct variable_size {
    };
 };
 
+// per-block min/max summaries of fixed-size columns
+//
+// Stored next to the column file <name>.bin as <name>.zones: a raw array with
+// one Zone per BLOCK_ROWS rows (the last block may be shorter).
+struct zone_map {
+   static constexpr uint64_t BLOCK_ROWS = 1ul << 16;
+
+   template<typename T>
+   struct Zone {
+      T min;
+      T max;
+   };
+
+   static constexpr uint64_t block_count(uint64_t rows) { return (rows + BLOCK_ROWS - 1) / BLOCK_ROWS; }
+};
+
 template<typename T>
 struct DataColumn : FileMapping<T> {
    using size_tag = fixed_size;
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/InstCombine/InstCombine.h>
+#include <llvm/Transforms/Scalar/SimplifyCFG.h>
+#include <llvm/Transforms/Utils/Mem2Reg.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "hashtable.hpp"
+#include "params.hpp"
+#include "types.hpp"
+
+namespace p2c {
+
+////////////////////////////////////////////////////////////////////////////////
+// LLVM backend: instead of printing C++ code, p2c emits LLVM IR for the plan
+// and compiles it in-process with the ORC JIT, which avoids the latency of a
+// C++ frontend. Generated code calls the runtime functions below for
+// everything that is not a tight loop (hash tables, sorting, output); they
+// are compiled into p2c and registered with the JIT by name.
+
+// rows of fixed width materialized by pipeline breakers; rows inserted with a hash are chained by it
+class JitRowTable {
+   static constexpr uint64_t empty = ~0ull;
+   // every row starts with its hash, followed by the payload laid out by the generated code
+   uint64_t width;
+   std::vector<uint8_t> data;
+   std::vector<uint64_t> chain;
+   std::vector<uint64_t> heads;
+   std::vector<uint8_t*> order;
+
+   uint64_t hashOf(uint64_t row) const { return *reinterpret_cast<const uint64_t*>(&data[row * width]); }
+   uint64_t index(const uint8_t* row) const { return (row - data.data()) / width; }
+
+   void link(uint64_t row) {
+      uint64_t& head = heads[hashOf(row) & (heads.size() - 1)];
+      chain[row] = head;
+      head = row;
+   }
+
+public:
+   explicit JitRowTable(uint64_t payloadWidth) : width(sizeof(uint64_t) + ((payloadWidth + 7) & ~7ull)), heads(1024, empty) {}
+
+   uint64_t size() const { return chain.size(); }
+   uint8_t* row(uint64_t i) { return &data[i * width]; }
+
+   // new zero-initialized row (pointers to rows are valid until the next append)
+   uint8_t* append(uint64_t hash) {
+      data.resize(data.size() + width);
+      chain.push_back(empty);
+      uint8_t* r = row(size() - 1);
+      *reinterpret_cast<uint64_t*>(r) = hash;
+      return r;
+   }
+
+   // new row that is found by first/next
+   uint8_t* insert(uint64_t hash) {
+      append(hash);
+      if (size() > heads.size()) {
+         heads.assign(heads.size() * 2, empty);
+         for (uint64_t i = 0; i != size(); i++)
+            link(i);
+      } else {
+         link(size() - 1);
+      }
+      return row(size() - 1);
+   }
+
+   // first/next inserted row with hash, nullptr at the end of the chain
+   uint8_t* first(uint64_t hash) { return find(heads[hash & (heads.size() - 1)], hash); }
+   uint8_t* next(const uint8_t* r, uint64_t hash) { return find(chain[index(r)], hash); }
+   uint8_t* find(uint64_t i, uint64_t hash) {
+      for (; i != empty; i = chain[i])
+         if (hashOf(i) == hash)
+            return row(i);
+      return nullptr;
+   }
+
+   // order the first limit rows with a three-way comparison, returns their number
+   uint64_t sort(int32_t (*cmp)(const uint8_t*, const uint8_t*), uint64_t limit) {
+      order.resize(size());
+      for (uint64_t i = 0; i != size(); i++)
+         order[i] = row(i);
+      auto less = [&](const uint8_t* a, const uint8_t* b) { return cmp(a, b) < 0; };
+      if (limit < order.size()) {
+         std::partial_sort(order.begin(), order.begin() + limit, order.end(), less);
+         order.resize(limit);
+      } else {
+         std::sort(order.begin(), order.end(), less);
+      }
+      return order.size();
+   }
+   uint8_t* sorted(uint64_t i) { return order[i]; }
+};
+
+// runtime functions called by generated code
+namespace jit_runtime {
+inline JitRowTable* rowsCreate(uint64_t payloadWidth) { return new JitRowTable(payloadWidth); }
+inline void rowsDestroy(JitRowTable* t) { delete t; }
+inline uint8_t* rowsAppend(JitRowTable* t) { return t->append(0); }
+inline uint8_t* rowsInsert(JitRowTable* t, uint64_t hash) { return t->insert(hash); }
+inline uint8_t* rowsFirst(JitRowTable* t, uint64_t hash) { return t->first(hash); }
+inline uint8_t* rowsNext(JitRowTable* t, const uint8_t* row, uint64_t hash) { return t->next(row, hash); }
+inline uint64_t rowsSize(JitRowTable* t) { return t->size(); }
+inline uint8_t* rowsAt(JitRowTable* t, uint64_t i) { return t->row(i); }
+inline uint64_t rowsSort(JitRowTable* t, int32_t (*cmp)(const uint8_t*, const uint8_t*), uint64_t limit) { return t->sort(cmp, limit); }
+inline uint8_t* rowsSorted(JitRowTable* t, uint64_t i) { return t->sorted(i); }
+
+inline uint64_t hashString(const char* s, uint64_t len) { return hashValue(std::string_view(s, len)); }
+inline int32_t compareString(const char* a, uint64_t aLen, const char* b, uint64_t bLen) {
+   int c = std::string_view(a, aLen).compare(std::string_view(b, bLen));
+   return (c > 0) - (c < 0);
+}
+
+inline int32_t paramInteger(const QueryParams* p, uint32_t i) { return p->get<int32_t>(i); }
+inline int64_t paramBigInt(const QueryParams* p, uint32_t i) { return p->get<int64_t>(i); }
+inline double paramDouble(const QueryParams* p, uint32_t i) { return p->get<double>(i); }
+inline char paramChar(const QueryParams* p, uint32_t i) { return p->get<char>(i); }
+inline int32_t paramDate(const QueryParams* p, uint32_t i) { return p->get<date>(i).value; }
+// string parameters are owned by the argument block
+inline uint64_t paramString(const QueryParams* p, uint32_t i, const char** data) {
+   auto& s = std::get<std::string>((*p)[i]);
+   *data = s.data();
+   return s.size();
+}
+
+// print value followed by a space (like the code generated by genPrint)
+inline void printInteger(int32_t v) { std::cout << v << " "; }
+inline void printBigInt(int64_t v) { std::cout << v << " "; }
+inline void printDouble(double v) { std::cout << v << " "; }
+inline void printChar(char v) { std::cout << v << " "; }
+inline void printBool(uint8_t v) { std::cout << static_cast<bool>(v) << " "; }
+inline void printDate(int32_t v) { std::cout << date(v) << " "; }
+inline void printString(const char* s, uint64_t len) { std::cout << std::string_view(s, len) << " "; }
+inline void printEnd() { std::cout << std::endl; }
+}  // namespace jit_runtime
+
+// ORC JIT that compiles modules of generated IR with the runtime functions linked in
+class Jit {
+   std::unique_ptr<llvm::orc::LLJIT> jit;
+
+   static void check(llvm::Error error) {
+      if (error)
+         throw std::runtime_error("LLVM: " + llvm::toString(std::move(error)));
+   }
+   template<typename T>
+   static T check(llvm::Expected<T> value) {
+      if (!value)
+         throw std::runtime_error("LLVM: " + llvm::toString(value.takeError()));
+      return std::move(*value);
+   }
+
+public:
+   Jit() {
+      static bool initialized = (llvm::InitializeNativeTarget(), llvm::InitializeNativeTargetAsmPrinter(), true);
+      (void)initialized;
+      jit = check(llvm::orc::LLJITBuilder().create());
+      using namespace jit_runtime;
+      llvm::orc::SymbolMap symbols;
+      auto add = [&](const char* name, auto* fn) {
+         symbols[jit->mangleAndIntern(name)] = llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(fn), llvm::JITSymbolFlags::Exported);
+      };
+      add("p2cRowsCreate", rowsCreate);
+      add("p2cRowsDestroy", rowsDestroy);
+      add("p2cRowsAppend", rowsAppend);
+      add("p2cRowsInsert", rowsInsert);
+      add("p2cRowsFirst", rowsFirst);
+      add("p2cRowsNext", rowsNext);
+      add("p2cRowsSize", rowsSize);
+      add("p2cRowsAt", rowsAt);
+      add("p2cRowsSort", rowsSort);
+      add("p2cRowsSorted", rowsSorted);
+      add("p2cHashString", hashString);
+      add("p2cCompareString", compareString);
+      add("p2cParamInteger", paramInteger);
+      add("p2cParamBigInt", paramBigInt);
+      add("p2cParamDouble", paramDouble);
+      add("p2cParamChar", paramChar);
+      add("p2cParamDate", paramDate);
+      add("p2cParamString", paramString);
+      add("p2cPrintInteger", printInteger);
+      add("p2cPrintBigInt", printBigInt);
+      add("p2cPrintDouble", printDouble);
+      add("p2cPrintChar", printChar);
+      add("p2cPrintBool", printBool);
+      add("p2cPrintDate", printDate);
+      add("p2cPrintString", printString);
+      add("p2cPrintEnd", printEnd);
+      check(jit->getMainJITDylib().define(llvm::orc::absoluteSymbols(std::move(symbols))));
+   }
+
+   const llvm::DataLayout& dataLayout() const { return jit->getDataLayout(); }
+
+   // verify and optimize module (cheap function passes only), compile it, and return the address of function 'name'
+   void* compile(std::unique_ptr<llvm::Module> module, std::unique_ptr<llvm::LLVMContext> context, const std::string& name) {
+      std::string errors;
+      llvm::raw_string_ostream errorStream(errors);
+      if (llvm::verifyModule(*module, &errorStream))
+         throw std::runtime_error("invalid IR: " + errorStream.str());
+
+      llvm::PassBuilder pb;
+      llvm::LoopAnalysisManager lam;
+      llvm::FunctionAnalysisManager fam;
+      llvm::CGSCCAnalysisManager cgam;
+      llvm::ModuleAnalysisManager mam;
+      pb.registerModuleAnalyses(mam);
+      pb.registerCGSCCAnalyses(cgam);
+      pb.registerFunctionAnalyses(fam);
+      pb.registerLoopAnalyses(lam);
+      pb.crossRegisterProxies(lam, fam, cgam, mam);
+      llvm::FunctionPassManager fpm;
+      fpm.addPass(llvm::PromotePass());
+      fpm.addPass(llvm::InstCombinePass());
+      fpm.addPass(llvm::SimplifyCFGPass());
+      llvm::ModulePassManager mpm;
+      mpm.addPass(llvm::createModuleToFunctionPassAdaptor(std::move(fpm)));
+      mpm.run(*module, mam);
+
+      check(jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(module), std::move(context))));
+      return reinterpret_cast<void*>(check(jit->lookup(name)).getAddress());
+   }
+};
+
+}  // namespace p2c
@@ -2,9 +2,15 @@
 
 #include <algorithm>
 #include <cassert>
+#include <charconv>
+#include <chrono>
+#include <cmath>
 #include <functional>
 #include <iostream>
 #include <map>
+#include <numeric>
+#include <optional>
+#include <set>
 #include <source_location>
 #include <sstream>
 #include <string>
@@ -22,6 +28,11 @@ using namespace fmt;
 #error "Neither <format> nor libfmt is available. Please install libfmt and link it in your Makefile."
 #endif
 
+#include "compile.hpp"
+#include "primitives.hpp"
+#ifdef P2C_LLVM
+#include "jit.hpp"
+#endif
 #include "tpch.hpp"
 #include "types.hpp"
 
@@ -150,12 +161,418 @@ bool operator==(const IUSet& a, const IUSet& b) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// canonical description of a plan that does not depend on generated variable names (key of the query cache)
+struct Fingerprint {
+   // IUs are numbered in the order they are defined or first used
+   map<IU*, unsigned> ids;
+
+   string iu(IU* iu) {
+      auto [it, inserted] = ids.try_emplace(iu, ids.size());
+      return format("${}:{}", it->second, tname(iu->type));
+   }
+   string ius(const vector<IU*>& v) {
+      vector<string> strs;
+      for (IU* x : v)
+         strs.push_back(iu(x));
+      return join(strs, ",");
+   }
+   // sets are ordered by pointer, so their ids are sorted
+   string ius(const IUSet& set) {
+      vector<string> strs;
+      for (IU* x : set)
+         strs.push_back(iu(x));
+      sort(strs.begin(), strs.end());
+      return join(strs, ",");
+   }
+   string sortKeys(const vector<IU*>& keys, const vector<bool>& ascending) {
+      vector<string> strs;
+      for (size_t i = 0; i != keys.size(); i++)
+         strs.push_back(iu(keys[i]) + (ascending[i] ? " asc" : " desc"));
+      return join(strs, ",");
+   }
+};
+
+// rows processed by the interpreter: values of the IUs for count rows
+struct Chunk {
+   uint32_t count = 0;
+   map<IU*, Vector> columns;
+};
+
+// chunk consumer callback function of the interpreter
+typedef std::function<void(Chunk&)> ChunkConsumer;
+
+// state of running a plan with the vectorized primitives of primitives.hpp instead of compiling it
+struct Interpreter {
+   ColumnStore& db;
+   const QueryParams& params;
+   // set by Limit: the source of the current pipeline stops producing chunks
+   bool stopped = false;
+   static constexpr uint32_t chunkSize = 1024;
+};
+
+#ifdef P2C_LLVM
+// value of generated IR with its p2c type (integers and dates are both i32)
+struct IRValue {
+   llvm::Value* value;
+   Type type;
+};
+
+// state of generating LLVM IR for a plan (--llvm, see jit.hpp)
+//
+// The plan is compiled into one function 'query(columns, counts, params)'.
+// The caller passes the base pointers of the scanned columns and the tuple
+// counts of the scanned relations in the order in which code generation
+// requested them. Values of IUs are SSA values; strings are {i8*, i64} pairs.
+struct IRGen {
+   unique_ptr<llvm::LLVMContext> context = make_unique<llvm::LLVMContext>();
+   unique_ptr<llvm::Module> module = make_unique<llvm::Module>("query", *context);
+   llvm::IRBuilder<> b{*context};
+   llvm::Function* fn;
+   // allocas, column pointers, parameters, and row tables are set up in the entry block
+   llvm::BasicBlock *entry, *body;
+   llvm::Value *columnsArg, *countsArg, *paramsArg;
+   // (relation, column, type) of the columns and tuple counts the caller passes
+   vector<tuple<string, string, Type>> columns, counts;
+   // values loaded in the entry block, by description
+   map<string, llvm::Value*> loaded;
+   // values of the IUs in the code that is currently generated
+   map<IU*, llvm::Value*> values;
+   // set by Limit: leave the loop of the current pipeline
+   llvm::Value* stop = nullptr;
+   // row tables, destroyed at the end of the query
+   vector<llvm::Value*> tables;
+
+   explicit IRGen(const llvm::DataLayout& layout) {
+      module->setDataLayout(layout);
+      auto fnType = llvm::FunctionType::get(b.getVoidTy(), {ptrType()->getPointerTo(), b.getInt64Ty()->getPointerTo(), ptrType()}, false);
+      fn = llvm::Function::Create(fnType, llvm::Function::ExternalLinkage, "query", *module);
+      columnsArg = fn->getArg(0);
+      countsArg = fn->getArg(1);
+      paramsArg = fn->getArg(2);
+      entry = block("entry");
+      body = block("body");
+      b.SetInsertPoint(body);
+   }
+
+   // end the query function
+   void finish() {
+      for (llvm::Value* table : tables)
+         call("p2cRowsDestroy", b.getVoidTy(), {table});
+      b.CreateRetVoid();
+      atEntry().CreateBr(body);
+   }
+
+   llvm::BasicBlock* block(const string& name) { return llvm::BasicBlock::Create(*context, name, b.GetInsertBlock() ? b.GetInsertBlock()->getParent() : fn); }
+   // builder that appends to the entry block (for values that all pipelines use)
+   llvm::IRBuilder<> atEntry() { return llvm::IRBuilder<>(entry); }
+   llvm::Value* local(llvm::Type* type) { return atEntry().CreateAlloca(type); }
+
+   llvm::PointerType* ptrType() { return b.getInt8PtrTy(); }
+   llvm::StructType* stringType() { return llvm::StructType::get(*context, {ptrType(), b.getInt64Ty()}); }
+   llvm::Type* type(Type t) {
+      switch (t) {
+         case Type::Integer: return b.getInt32Ty();
+         case Type::Double: return b.getDoubleTy();
+         case Type::Char: return b.getInt8Ty();
+         case Type::String: return stringType();
+         case Type::BigInt: return b.getInt64Ty();
+         case Type::Bool: return b.getInt1Ty();
+         case Type::Date: return b.getInt32Ty();
+         default: throw logic_error("unknown type");
+      }
+   }
+   llvm::Value* makeString(llvm::IRBuilder<>& builder, llvm::Value* data, llvm::Value* length) {
+      llvm::Value* s = builder.CreateInsertValue(llvm::UndefValue::get(stringType()), data, 0);
+      return builder.CreateInsertValue(s, length, 1);
+   }
+
+   // call runtime function (see jit.hpp)
+   llvm::Value* call(llvm::IRBuilder<>& builder, const string& name, llvm::Type* result, const vector<llvm::Value*>& args) {
+      vector<llvm::Type*> params;
+      for (llvm::Value* arg : args)
+         params.push_back(arg->getType());
+      return builder.CreateCall(module->getOrInsertFunction(name, llvm::FunctionType::get(result, params, false)), args);
+   }
+   llvm::Value* call(const string& name, llvm::Type* result, const vector<llvm::Value*>& args) { return call(b, name, result, args); }
+
+   // base pointer of a column, passed by the caller
+   llvm::Value* column(const string& relation, const string& name, Type t) {
+      string key = format("column {}.{}", relation, name);
+      if (!loaded.contains(key)) {
+         auto builder = atEntry();
+         loaded[key] = builder.CreateLoad(ptrType(), builder.CreateConstGEP1_64(ptrType(), columnsArg, columns.size()));
+         columns.emplace_back(relation, name, t);
+      }
+      return loaded[key];
+   }
+   // tuple count of a relation (determined by one of its columns), passed by the caller
+   llvm::Value* tupleCount(const string& relation, const string& firstColumn, Type t) {
+      string key = format("count {}", relation);
+      if (!loaded.contains(key)) {
+         auto builder = atEntry();
+         loaded[key] = builder.CreateLoad(b.getInt64Ty(), builder.CreateConstGEP1_64(b.getInt64Ty(), countsArg, counts.size()));
+         counts.emplace_back(relation, firstColumn, t);
+      }
+      return loaded[key];
+   }
+   // value i of a column (strings are stored as slots {size, offset} after the count)
+   llvm::Value* load(llvm::Value* base, Type t, llvm::Value* i) {
+      if (t != Type::String)
+         return b.CreateLoad(type(t), b.CreateGEP(type(t), b.CreatePointerCast(base, type(t)->getPointerTo()), i));
+      auto i64 = b.getInt64Ty();
+      llvm::Value* slot = b.CreateGEP(i64, b.CreatePointerCast(base, i64->getPointerTo()), b.CreateAdd(b.CreateMul(i, b.getInt64(2)), b.getInt64(1)));
+      llvm::Value* size = b.CreateLoad(i64, slot);
+      llvm::Value* offset = b.CreateLoad(i64, b.CreateConstGEP1_64(i64, slot, 1));
+      return makeString(b, b.CreateGEP(b.getInt8Ty(), base, offset), size);
+   }
+
+   // query parameter, read once per query
+   IRValue param(Type t, unsigned index) {
+      string key = format("param {}", index);
+      if (!loaded.contains(key)) {
+         auto builder = atEntry();
+         vector<llvm::Value*> args = {paramsArg, builder.getInt32(index)};
+         if (t == Type::String) {
+            llvm::Value* data = builder.CreateAlloca(ptrType());
+            args.push_back(data);
+            llvm::Value* length = call(builder, "p2cParamString", b.getInt64Ty(), args);
+            loaded[key] = makeString(builder, builder.CreateLoad(ptrType(), data), length);
+         } else {
+            loaded[key] = call(builder, "p2cParam" + typeName(t), type(t), args);
+         }
+      }
+      return {loaded[key], t};
+   }
+
+   template<typename T>
+   IRValue constant(const T& x) {
+      if constexpr (is_same_v<T, string_view>)
+         return {makeString(b, b.CreateGlobalStringPtr(llvm::StringRef(x.data(), x.size())), b.getInt64(x.size())), Type::String};
+      else if constexpr (is_same_v<T, double>)
+         return {llvm::ConstantFP::get(b.getDoubleTy(), x), Type::Double};
+      else if constexpr (is_same_v<T, date>)
+         return {b.getInt32(x.value), Type::Date};
+      else
+         return {llvm::ConstantInt::get(type(type_tag<T>::tag), x, is_signed_v<T>), type_tag<T>::tag};
+   }
+
+   // name of the runtime functions for a type
+   static string typeName(Type t) {
+      static const char* names[] = {"Integer", "Double", "Char", "String", "BigInt", "Bool", "Date"};
+      return names[static_cast<unsigned>(t)];
+   }
+
+   IRValue cast(IRValue v, Type t) {
+      if (v.type == t)
+         return v;
+      bool isInt = v.type == Type::Integer || v.type == Type::Date;
+      if (t == Type::Double && (isInt || v.type == Type::BigInt))
+         return {b.CreateSIToFP(v.value, b.getDoubleTy()), t};
+      if (t == Type::BigInt && isInt)
+         return {b.CreateSExt(v.value, b.getInt64Ty()), t};
+      if (t == Type::Integer && v.type == Type::BigInt)
+         return {b.CreateTrunc(v.value, b.getInt32Ty()), t};
+      if ((t == Type::Date || t == Type::Integer) && isInt)
+         return {v.value, t};
+      throw runtime_error(format("cannot convert {} to {}", tname(v.type), tname(t)));
+   }
+
+   // 'a op b' for values of the same type
+   llvm::Value* compare(CmpOp op, IRValue a, IRValue c) {
+      llvm::Value *x = a.value, *y = c.value;
+      if (a.type == Type::String) {
+         x = call("p2cCompareString", b.getInt32Ty(), {b.CreateExtractValue(x, 0), b.CreateExtractValue(x, 1), b.CreateExtractValue(y, 0), b.CreateExtractValue(y, 1)});
+         y = b.getInt32(0);
+      }
+      if (a.type == Type::Double) {
+         static const llvm::CmpInst::Predicate preds[] = {llvm::CmpInst::FCMP_OEQ, llvm::CmpInst::FCMP_UNE, llvm::CmpInst::FCMP_OLT, llvm::CmpInst::FCMP_OLE, llvm::CmpInst::FCMP_OGT, llvm::CmpInst::FCMP_OGE};
+         return b.CreateFCmp(preds[static_cast<unsigned>(op)], x, y);
+      }
+      static const llvm::CmpInst::Predicate signedPreds[] = {llvm::CmpInst::ICMP_EQ, llvm::CmpInst::ICMP_NE, llvm::CmpInst::ICMP_SLT, llvm::CmpInst::ICMP_SLE, llvm::CmpInst::ICMP_SGT, llvm::CmpInst::ICMP_SGE};
+      static const llvm::CmpInst::Predicate unsignedPreds[] = {llvm::CmpInst::ICMP_EQ, llvm::CmpInst::ICMP_NE, llvm::CmpInst::ICMP_ULT, llvm::CmpInst::ICMP_ULE, llvm::CmpInst::ICMP_UGT, llvm::CmpInst::ICMP_UGE};
+      return b.CreateICmp((a.type == Type::Bool ? unsignedPreds : signedPreds)[static_cast<unsigned>(op)], x, y);
+   }
+   // three-way comparison: -1, 0, 1
+   llvm::Value* compare3(IRValue a, IRValue c) {
+      auto i32 = b.getInt32Ty();
+      return b.CreateSub(b.CreateZExt(compare(CmpOp::Gt, a, c), i32), b.CreateZExt(compare(CmpOp::Lt, a, c), i32));
+   }
+
+   IRValue binary(BinaryOp op, IRValue a, IRValue c) {
+      bool isDouble = a.type == Type::Double;
+      if (a.type == Type::Bool && (op == BinaryOp::And || op == BinaryOp::Or))
+         return {op == BinaryOp::And ? b.CreateAnd(a.value, c.value) : b.CreateOr(a.value, c.value), a.type};
+      if (a.type == Type::String || a.type == Type::Char || a.type == Type::Bool)
+         throw runtime_error("no arithmetic on " + tname(a.type));
+      switch (op) {
+         case BinaryOp::Plus: return {isDouble ? b.CreateFAdd(a.value, c.value) : b.CreateAdd(a.value, c.value), a.type};
+         case BinaryOp::Minus: return {isDouble ? b.CreateFSub(a.value, c.value) : b.CreateSub(a.value, c.value), a.type};
+         case BinaryOp::Multiplies: return {isDouble ? b.CreateFMul(a.value, c.value) : b.CreateMul(a.value, c.value), a.type};
+         case BinaryOp::Divides: return {isDouble ? b.CreateFDiv(a.value, c.value) : b.CreateSDiv(a.value, c.value), a.type};
+         default: throw runtime_error("no logical operators on " + tname(a.type));
+      }
+   }
+
+   // murmur3 finalizer and hash of values, same as hashMix and hashValue of hashtable.hpp
+   llvm::Value* hashMix(llvm::Value* k) {
+      k = b.CreateXor(k, b.CreateLShr(k, 33));
+      k = b.CreateMul(k, b.getInt64(0xff51afd7ed558ccdull));
+      k = b.CreateXor(k, b.CreateLShr(k, 33));
+      k = b.CreateMul(k, b.getInt64(0xc4ceb9fe1a85ec53ull));
+      return b.CreateXor(k, b.CreateLShr(k, 33));
+   }
+   llvm::Value* hash(const vector<IRValue>& keys) {
+      llvm::Value* h = b.getInt64(0);
+      for (const IRValue& key : keys) {
+         llvm::Value* v;
+         if (key.type == Type::String)
+            v = call("p2cHashString", b.getInt64Ty(), {b.CreateExtractValue(key.value, 0), b.CreateExtractValue(key.value, 1)});
+         else if (key.type == Type::Double)
+            v = b.CreateBitCast(key.value, b.getInt64Ty());
+         else
+            v = b.CreateZExt(key.value, b.getInt64Ty());
+         h = hashMix(b.CreateXor(h, v));
+      }
+      return h;
+   }
+
+   void print(IU* iu) {
+      llvm::Value* v = values.at(iu);
+      if (iu->type == Type::String)
+         call("p2cPrintString", b.getVoidTy(), {b.CreateExtractValue(v, 0), b.CreateExtractValue(v, 1)});
+      else
+         call("p2cPrint" + typeName(iu->type), b.getVoidTy(), {iu->type == Type::Bool ? b.CreateZExt(v, b.getInt8Ty()) : v});
+   }
+
+   // new row table of the query
+   llvm::Value* createTable(unsigned payloadWidth) {
+      auto builder = atEntry();
+      tables.push_back(call(builder, "p2cRowsCreate", ptrType(), {builder.getInt64(payloadWidth)}));
+      return tables.back();
+   }
+
+   // generate loop over [0, n) that stops when Limit sets 'stop' (starts a pipeline)
+   template<class Fn>
+   void genLoop(llvm::Value* n, Fn fn) {
+      llvm::Value* outerStop = stop;
+      stop = local(b.getInt1Ty());
+      b.CreateStore(b.getFalse(), stop);
+      llvm::Value* counter = local(b.getInt64Ty());
+      b.CreateStore(b.getInt64(0), counter);
+      auto head = block("loop"), loopBody = block("loopBody"), done = block("loopDone");
+      b.CreateBr(head);
+      b.SetInsertPoint(head);
+      llvm::Value* i = b.CreateLoad(b.getInt64Ty(), counter);
+      b.CreateCondBr(b.CreateAnd(b.CreateICmpULT(i, n), b.CreateNot(b.CreateLoad(b.getInt1Ty(), stop))), loopBody, done);
+      b.SetInsertPoint(loopBody);
+      fn(i);
+      b.CreateStore(b.CreateAdd(i, b.getInt64(1)), counter);
+      b.CreateBr(head);
+      b.SetInsertPoint(done);
+      stop = outerStop;
+   }
+
+   template<class Fn>
+   void genIf(llvm::Value* cond, Fn fn) {
+      auto then = block("then"), done = block("endIf");
+      b.CreateCondBr(cond, then, done);
+      b.SetInsertPoint(then);
+      fn();
+      b.CreateBr(done);
+      b.SetInsertPoint(done);
+   }
+
+   template<class Then, class Else>
+   void genIfElse(llvm::Value* cond, Then thenFn, Else elseFn) {
+      auto then = block("then"), otherwise = block("else"), done = block("endIf");
+      b.CreateCondBr(cond, then, otherwise);
+      b.SetInsertPoint(then);
+      thenFn();
+      b.CreateBr(done);
+      b.SetInsertPoint(otherwise);
+      elseFn();
+      b.CreateBr(done);
+      b.SetInsertPoint(done);
+   }
+
+   // generate loop over the rows of table inserted with hash
+   template<class Fn>
+   void genChain(llvm::Value* table, llvm::Value* h, Fn fn) {
+      llvm::Value* row = local(ptrType());
+      b.CreateStore(call("p2cRowsFirst", ptrType(), {table, h}), row);
+      auto head = block("chain"), chainBody = block("chainBody"), done = block("chainDone");
+      b.CreateBr(head);
+      b.SetInsertPoint(head);
+      llvm::Value* r = b.CreateLoad(ptrType(), row);
+      b.CreateCondBr(b.CreateIsNotNull(r), chainBody, done);
+      b.SetInsertPoint(chainBody);
+      fn(r);
+      b.CreateStore(call("p2cRowsNext", ptrType(), {table, r, h}), row);
+      b.CreateBr(head);
+      b.SetInsertPoint(done);
+   }
+
+   // first row of table inserted with hash for which match(row) holds, null if there is none
+   template<class Fn>
+   llvm::Value* genFind(llvm::Value* table, llvm::Value* h, Fn match) {
+      llvm::Value* row = local(ptrType());
+      b.CreateStore(call("p2cRowsFirst", ptrType(), {table, h}), row);
+      auto head = block("find"), check = block("findCheck"), advance = block("findNext"), done = block("findDone");
+      b.CreateBr(head);
+      b.SetInsertPoint(head);
+      llvm::Value* r = b.CreateLoad(ptrType(), row);
+      b.CreateCondBr(b.CreateIsNull(r), done, check);
+      b.SetInsertPoint(check);
+      b.CreateCondBr(match(r), done, advance);
+      b.SetInsertPoint(advance);
+      b.CreateStore(call("p2cRowsNext", ptrType(), {table, r, h}), row);
+      b.CreateBr(head);
+      b.SetInsertPoint(done);
+      return b.CreateLoad(ptrType(), row);
+   }
+};
+
+// layout of IU values in the rows of a JitRowTable (after the row's hash)
+struct IRRow {
+   vector<IU*> ius;
+   vector<unsigned> offsets;
+   unsigned width = 0;
+
+   explicit IRRow(const vector<IU*>& ius) : ius(ius) {
+      for (IU* iu : ius) {
+         unsigned size = iu->type == Type::String ? 16 : typeWidth(iu->type);
+         unsigned align = min(size, 8u);
+         width = (width + align - 1) / align * align;
+         offsets.push_back(width);
+         width += size;
+      }
+   }
+
+   llvm::Value* pointer(IRGen& ir, llvm::Value* row, IU* iu) {
+      unsigned offset = offsets[find(ius.begin(), ius.end(), iu) - ius.begin()];
+      return ir.b.CreatePointerCast(ir.b.CreateConstGEP1_64(ir.b.getInt8Ty(), row, sizeof(uint64_t) + offset), ir.type(iu->type)->getPointerTo());
+   }
+   llvm::Value* load(IRGen& ir, llvm::Value* row, IU* iu) { return ir.b.CreateLoad(ir.type(iu->type), pointer(ir, row, iu)); }
+   void store(IRGen& ir, llvm::Value* row, IU* iu, llvm::Value* value) { ir.b.CreateStore(value, pointer(ir, row, iu)); }
+};
+#endif
+
 // abstract base class of all expressions
 struct Exp {
    // compile expression to string
    virtual string compile() = 0;
+   // canonical description of the expression
+   virtual string fingerprint(Fingerprint& fp) = 0;
+   // compute the expression for the rows of a chunk (interpreter)
+   virtual Vector evaluate(Interpreter& in, const Chunk& chunk) = 0;
+#ifdef P2C_LLVM
+   // generate LLVM IR computing the expression
+   virtual IRValue compileIR(IRGen& ir) = 0;
+#endif
    // set of all IUs used in this expression
    virtual IUSet iusUsed() = 0;
+   // value of the expression if it is a constant (optimizer)
+   virtual optional<Vector> constantValue() { return nullopt; }
    // destructor
    virtual ~Exp(){};
 };
@@ -170,6 +587,11 @@ struct IUExp : public Exp {
    ~IUExp() {}
 
    string compile() override { return iu->varname; }
+   string fingerprint(Fingerprint& fp) override { return fp.iu(iu); }
+   Vector evaluate(Interpreter& in, const Chunk& chunk) override { return chunk.columns.at(iu); }
+#ifdef P2C_LLVM
+   IRValue compileIR(IRGen& ir) override { return {ir.values.at(iu), iu->type}; }
+#endif
    IUSet iusUsed() override { return IUSet({iu}); }
 };
 
@@ -187,10 +609,47 @@ struct ConstExp : public Exp {
    string compile() override {
       if constexpr (type_tag<T>::tag == Type::String) {
          return format("\"{}\"", x);  // Add quotes for strings
+      } else if constexpr (type_tag<T>::tag == Type::Char) {
+         return format("'{}'", x);
+      } else if constexpr (type_tag<T>::tag == Type::Double) {
+         return format("{:#}", x);  // always with decimal point, so the literal stays a double
       } else {
          return format("{}", x);
       }
    }
+   string fingerprint(Fingerprint& fp) override { return format("{}{{{}}}", tname(type_tag<T>::tag), compile()); }
+   Vector evaluate(Interpreter& in, const Chunk& chunk) override { return Vector::constantOf(x); }
+#ifdef P2C_LLVM
+   IRValue compileIR(IRGen& ir) override { return ir.constant(x); }
+#endif
+   IUSet iusUsed() override { return {}; }
+   optional<Vector> constantValue() override { return Vector::constantOf(x); }
+};
+
+// create constant expression holding the first value of v (helper)
+unique_ptr<Exp> makeConstExp(const Vector& v) {
+   return dispatchType(v.type, [&](auto tag) -> unique_ptr<Exp> { return make_unique<ConstExp<typename decltype(tag)::type>>(v.at<typename decltype(tag)::type>(0)); });
+}
+
+// expression that reads a query parameter from the argument block 'params' at runtime
+template<typename T>
+requires is_p2c_type<T>
+struct ParamExp : public Exp {
+   // index in the argument block
+   unsigned index;
+
+   // constructor
+   ParamExp(unsigned index) : index(index) {}
+   // destructor
+   ~ParamExp() {}
+
+   string compile() override { return format("params.get<{}>({})", tname(type_tag<T>::tag), index); }
+   // the value is not part of the fingerprint, so all values share a compiled query
+   string fingerprint(Fingerprint& fp) override { return format("param<{}>({})", tname(type_tag<T>::tag), index); }
+   Vector evaluate(Interpreter& in, const Chunk& chunk) override { return Vector::constantOf(in.params.get<T>(index)); }
+#ifdef P2C_LLVM
+   IRValue compileIR(IRGen& ir) override { return ir.param(type_tag<T>::tag, index); }
+#endif
    IUSet iusUsed() override { return {}; }
 };
 
@@ -213,6 +672,69 @@ struct FnExp : public Exp {
       return format("{}({})", fnName, join(strs, ","));
    }
 
+   string fingerprint(Fingerprint& fp) override {
+      vector<string> strs;
+      for (auto& e : args)
+         strs.emplace_back(e->fingerprint(fp));
+      return format("{}({})", fnName, join(strs, ","));
+   }
+
+   // comparison operator of a function name
+   static optional<CmpOp> comparison(const string& fnName) {
+      static const map<string, CmpOp> ops = {
+          {"std::equal_to()", CmpOp::Eq}, {"std::not_equal_to()", CmpOp::Ne}, {"std::less()", CmpOp::Lt},
+          {"std::less_equal()", CmpOp::Le}, {"std::greater()", CmpOp::Gt}, {"std::greater_equal()", CmpOp::Ge},
+      };
+      auto it = ops.find(fnName);
+      return it == ops.end() ? nullopt : optional(it->second);
+   }
+
+   // evaluate both arguments, converted to a common type (helper)
+   pair<Vector, Vector> evaluateArgs(Interpreter& in, const Chunk& chunk) {
+      if (args.size() != 2)
+         throw runtime_error(format("interpreter does not support {} with {} arguments", fnName, args.size()));
+      Vector a = args[0]->evaluate(in, chunk), b = args[1]->evaluate(in, chunk);
+      Type t = commonType(a.type, b.type);
+      return {cast(a, t, chunk.count), cast(b, t, chunk.count)};
+   }
+
+   // arithmetic or logical operator of a function name
+   static optional<BinaryOp> binaryOp(const string& fnName) {
+      static const map<string, BinaryOp> ops = {
+          {"std::plus()", BinaryOp::Plus}, {"std::minus()", BinaryOp::Minus}, {"std::multiplies()", BinaryOp::Multiplies},
+          {"std::divides()", BinaryOp::Divides}, {"std::logical_and()", BinaryOp::And}, {"std::logical_or()", BinaryOp::Or},
+      };
+      auto it = ops.find(fnName);
+      return it == ops.end() ? nullopt : optional(it->second);
+   }
+
+   Vector evaluate(Interpreter& in, const Chunk& chunk) override {
+      auto [a, b] = evaluateArgs(in, chunk);
+      if (auto op = comparison(fnName))
+         return compare(*op, a, b, chunk.count);
+      auto op = binaryOp(fnName);
+      if (!op)
+         throw runtime_error(format("interpreter does not support {}", fnName));
+      return binary(*op, a, b, chunk.count);
+   }
+
+#ifdef P2C_LLVM
+   IRValue compileIR(IRGen& ir) override {
+      if (args.size() != 2)
+         throw runtime_error(format("LLVM backend does not support {} with {} arguments", fnName, args.size()));
+      IRValue a = args[0]->compileIR(ir), b = args[1]->compileIR(ir);
+      Type t = commonType(a.type, b.type);
+      a = ir.cast(a, t);
+      b = ir.cast(b, t);
+      if (auto op = comparison(fnName))
+         return {ir.compare(*op, a, b), Type::Bool};
+      auto op = binaryOp(fnName);
+      if (!op)
+         throw runtime_error(format("LLVM backend does not support {}", fnName));
+      return ir.binary(*op, a, b);
+   }
+#endif
+
    IUSet iusUsed() override {
       IUSet result;
       for (auto& exp : args)
@@ -220,8 +742,39 @@ struct FnExp : public Exp {
             result.add(iu);
       return result;
    }
+
+   // compute the value of the function if all arguments are constants, e.g., std::minus()(1, 0.05) (optimizer)
+   optional<Vector> constantValue() override {
+      if (args.size() != 2)
+         return nullopt;
+      optional<Vector> a = args[0]->constantValue(), b = args[1]->constantValue();
+      auto op = binaryOp(fnName);
+      auto cmp = comparison(fnName);
+      if (!a || !b || (!op && !cmp))
+         return nullopt;
+      Type t = commonType(a->type, b->type);
+      // arithmetic on dates, chars, and strings is not folded
+      if (op && t != Type::Integer && t != Type::BigInt && t != Type::Double && t != Type::Bool)
+         return nullopt;
+      Vector x = cast(*a, t, 1), y = cast(*b, t, 1);
+      // integer division by zero is left to the query
+      if (op == BinaryOp::Divides && t != Type::Double && dispatchType(t, [&](auto tag) { return y.at<typename decltype(tag)::type>(0) == typename decltype(tag)::type{}; }))
+         return nullopt;
+      return cmp ? compare(*cmp, x, y, 1) : binary(*op, x, y, 1);
+   }
 };
 
+// replace constant function calls in exp by their values (optimizer helper)
+void foldConstants(unique_ptr<Exp>& exp) {
+   auto fn = dynamic_cast<FnExp*>(exp.get());
+   if (!fn)
+      return;
+   for (auto& arg : fn->args)
+      foldConstants(arg);
+   if (auto value = fn->constantValue())
+      exp = makeConstExp(*value);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 // generate curly-brace block of C++ code (helper)
@@ -232,9 +785,290 @@ void genBlock(const string& str, Fn fn, const std::source_location& location = s
    cout << "}" << endl;
 }
 
+// generate call that takes a lambda whose body is generated by fn, optionally followed by more arguments (helper)
+template<class Fn>
+void genLambda(const string& call, const string& params, Fn fn, const string& moreArgs = "", const std::source_location& location = std::source_location::current()) {
+   cout << call << "[&](" << params << ") { //" << location.line() << "; " << location.function_name() << endl;
+   fn();
+   cout << "}" << moreArgs << ");" << endl;
+}
+
 // consumer callback function
 typedef std::function<void(void)> ConsumerFn;
 
+// state of a pipeline that is generated in vectorized (batch-at-a-time) mode
+struct Batch {
+   static constexpr unsigned size = 1024;
+   // selection vector (positions of the qualifying rows within the batch) and its length
+   string sel, count;
+   // generates code that accesses an IU at a row position
+   map<IU*, function<string(const string&)>> columns;
+   // fixed-size IUs that are stored in an array indexed by row position (usable by SIMD kernels)
+   map<IU*, string> arrays;
+   // selection vector is known to contain all rows of the batch
+   bool dense = false;
+
+   // load IUs of row position 'pos' into local variables
+   void provide(const IUSet& ius, const string& pos) {
+      for (IU* iu : ius)
+         provideIU(iu, columns.at(iu)(pos));
+   }
+};
+
+// batch of the pipeline that is currently generated (nullptr in tuple-at-a-time mode)
+Batch* currentBatch = nullptr;
+
+// generate loop over the selected rows of a batch that continues tuple-at-a-time (helper)
+void flattenBatch(const IUSet& required, ConsumerFn consume) {
+   Batch* batch = currentBatch;
+   genBlock(format("for (uint32_t k = 0; k != {}; k++)", batch->count), [&]() {
+      print("uint32_t pos = {}[k];\n", batch->sel);
+      batch->provide(required, "pos");
+      currentBatch = nullptr;
+      consume();
+      currentBatch = batch;
+   });
+}
+
+// wrap consumer that only works tuple-at-a-time, flattening batches if necessary (helper)
+ConsumerFn tupleAtATime(const IUSet& required, ConsumerFn consume) {
+   return [=]() {
+      if (currentBatch)
+         flattenBatch(required, consume);
+      else
+         consume();
+   };
+}
+
+// pipeline whose source loop is currently generated
+struct Pipeline {
+   // flags set by consumers (e.g., Limit) once the pipeline can stop
+   vector<string> stopFlags;
+};
+
+Pipeline* currentPipeline = nullptr;
+
+// consume tuples produced by a source loop, then exit the loop if a consumer requested a stop (helper)
+void consumeInPipeline(ConsumerFn consume) {
+   Pipeline* outer = currentPipeline;
+   Pipeline pipeline;
+   currentPipeline = &pipeline;
+   consume();
+   currentPipeline = outer;
+   for (auto& flag : pipeline.stopFlags)
+      print("if ({}.load(memory_order_relaxed)) break;\n", flag);
+}
+
+// generate scan pipelines whose morsels switch to the optimized build once it is loaded (tiered execution, see tiering.hpp)
+bool tieredPipelines = false;
+unsigned tieredPipelineCount = 0;
+
+// generate every pipeline in its own translation unit, so the units compile in parallel (library mode, see compile.hpp)
+//
+// State shared by pipelines (hash tables, sorters, flags) is declared with
+// genState and becomes a member of struct QueryState in state.hpp. Each
+// pipeline's morsel body is the member function pipelineN, defined in
+// pipelineN.cpp; QueryState::run in query.cpp runs the pipelines in order
+// and contains the code between them (e.g., merging, sequential output loops).
+struct SplitUnits {
+   filesystem::path dir;
+   unsigned pipelineCount = 0;
+   // names of the state variables in state.hpp
+   set<string> declared;
+};
+optional<SplitUnits> splitUnits;
+
+// generate declaration of state variable varname that pipelines share (helper)
+//
+// Code that is generated twice (the probe side of a join with both
+// strategies) declares the variable once; only one of the copies runs.
+template<class Fn>
+void genState(const string& varname, Fn fn) {
+   if (!splitUnits) {
+      fn();
+      return;
+   }
+   if (!splitUnits->declared.insert(varname).second)
+      return;
+   StdoutRedirect redirect(splitUnits->dir / "state.hpp", true);
+   fn();
+}
+
+// generate morsel lambda '[&](uint64_t begin, uint64_t end)' of a pipeline whose body is generated by fn, between prefix and suffix (helper)
+template<class Fn>
+void genPipeline(const string& prefix, Fn fn, const string& suffix = ");", const std::source_location& location = std::source_location::current()) {
+   if (!splitUnits) {
+      cout << prefix << "[&](uint64_t begin, uint64_t end) { //" << location.line() << "; " << location.function_name() << endl;
+      fn();
+      cout << "}" << suffix << endl;
+      return;
+   }
+   unsigned pipeline = splitUnits->pipelineCount++;
+   {
+      StdoutRedirect redirect(splitUnits->dir / format("pipeline{}.cpp", pipeline));
+      print("#include \"query.hpp\"\n#include \"state.hpp\"\n");
+      print("namespace generated __attribute__((visibility(\"hidden\"))) {{\n");
+      genBlock(format("void QueryState::pipeline{}(uint64_t begin, uint64_t end)", pipeline), fn, location);
+      print("}}\n");
+   }
+   print("{}[&](uint64_t begin, uint64_t end) {{ pipeline{}(begin, end); }}{}\n", prefix, pipeline, suffix);
+}
+
+// Bloom filter passed sideways from a join's build side to the scan of its probe side
+struct ScanFilter {
+   // probe-side keys that are checked against the filter
+   vector<IU*> keyIUs;
+   // types of the build-side keys (the filter contains hashes of this tuple type)
+   string keyTypes;
+   // variable name of the filter
+   string varname;
+};
+
+// comparison of an IU with a constant or parameter, e.g., o_orderdate < 1995-01-01
+struct Comparison {
+   IU* iu;
+   // operator name of CmpOp in simd.hpp
+   string op;
+   string constant;
+   // expression of the constant (owned by the predicate)
+   Exp* value;
+};
+
+// match predicate of the form 'iu op constant' or 'constant op iu' (helper)
+optional<Comparison> matchComparison(Exp* exp) {
+   static const map<string, pair<string, string>> ops = {
+       // function: operator, operator with swapped arguments
+       {"std::equal_to()", {"Eq", "Eq"}},
+       {"std::not_equal_to()", {"Ne", "Ne"}},
+       {"std::less()", {"Lt", "Gt"}},
+       {"std::less_equal()", {"Le", "Ge"}},
+       {"std::greater()", {"Gt", "Lt"}},
+       {"std::greater_equal()", {"Ge", "Le"}},
+   };
+   auto fn = dynamic_cast<FnExp*>(exp);
+   if (!fn || fn->args.size() != 2 || !ops.contains(fn->fnName))
+      return nullopt;
+   bool swapped = !dynamic_cast<IUExp*>(fn->args[0].get());
+   auto column = dynamic_cast<IUExp*>(fn->args[swapped ? 1 : 0].get());
+   Exp* constant = fn->args[swapped ? 0 : 1].get();
+   if (!column || constant->iusUsed().size())
+      return nullopt;
+   auto& [op, swappedOp] = ops.at(fn->fnName);
+   return Comparison{column->iu, swapped ? swappedOp : op, constant->compile(), constant};
+}
+
+// column statistics of the database that plans are optimized for (cost-based join ordering)
+//
+// Row counts come from the column files. Distinct values, histograms, and most
+// common values come from the statistics files of the data generator (see
+// ColumnStats). Without them, the number of distinct values of an integer,
+// char, or date column is estimated as the size of its value range in the zone
+// maps, which is exact for dense keys; it is unknown for other columns.
+struct Statistics {
+   ColumnStore columns;
+   map<pair<string, string>, optional<double>> distinct;
+
+   explicit Statistics(const string& dataDir) : columns(dataDir) {}
+
+   uint64_t rowCount(const string& relation) {
+      auto& [name, type] = TPCH::schema.at(relation).front();
+      return columns.tupleCount(relation, name, type);
+   }
+
+   // estimated number of distinct values of a column, nullopt if unknown
+   optional<double> distinctValues(const string& relation, const string& name, Type type) {
+      auto [it, inserted] = distinct.try_emplace({relation, name});
+      if (!inserted)
+         return it->second;
+      it->second = dispatchType(type, [&](auto tag) -> optional<double> {
+         using T = typename decltype(tag)::type;
+         if (auto stats = columns.columnStats<T>(relation, name))
+            return std::max(1.0, stats->distinct);
+         if constexpr (is_integral_v<T> || is_same_v<T, date>) {
+            auto& zones = columns.column<T>(relation, name).zones;
+            if (!zones.size())
+               return nullopt;
+            auto value = [](const T& x) -> double {
+               if constexpr (is_same_v<T, date>)
+                  return x.value;
+               else
+                  return x;
+            };
+            double min = value(zones[0].min), max = value(zones[0].max);
+            for (auto& zone : zones) {
+               min = std::min(min, value(zone.min));
+               max = std::max(max, value(zone.max));
+            }
+            return std::min<double>(max - min + 1, rowCount(relation));
+         } else {
+            return nullopt;
+         }
+      });
+      return it->second;
+   }
+
+   // relation of a column, nullptr if no relation has a column of this name and type
+   const string* relationOf(const string& name, Type type) {
+      for (auto& [relation, columns] : TPCH::schema)
+         for (auto& [column, t] : columns)
+            if (column == name && t == type)
+               return &relation;
+      return nullptr;
+   }
+
+   // estimated fraction of the rows of a column that satisfy 'column op constant', nullopt without statistics files
+   optional<double> selectivity(const string& relation, const string& name, Type type, const string& op, const Vector& constant) {
+      return dispatchType(type, [&](auto tag) -> optional<double> {
+         using T = typename decltype(tag)::type;
+         auto stats = columns.columnStats<T>(relation, name);
+         if (!stats)
+            return nullopt;
+         // constant converted to the type of the column (numbers only)
+         optional<T> x;
+         if (constant.type == type) {
+            x = constant.at<T>(0);
+         } else if constexpr (is_arithmetic_v<T> && !is_same_v<T, bool>) {
+            x = dispatchType(constant.type, [&](auto ctag) -> optional<T> {
+               using C = typename decltype(ctag)::type;
+               if constexpr (is_arithmetic_v<C> && !is_same_v<C, bool>)
+                  return T(constant.at<C>(0));
+               else
+                  return nullopt;
+            });
+         }
+         if (!x)
+            return nullopt;
+         if (op == "Eq")
+            return stats->equalFraction(*x);
+         if (op == "Ne")
+            return 1 - stats->equalFraction(*x);
+         if (op == "Lt")
+            return stats->lessFraction(*x, false);
+         if (op == "Le")
+            return stats->lessFraction(*x, true);
+         if (op == "Gt")
+            return 1 - stats->lessFraction(*x, true);
+         return 1 - stats->lessFraction(*x, false);
+      });
+   }
+};
+// statistics of the database in library mode or of data-generator/output/ (if it exists); join order is kept without them
+optional<Statistics> statistics;
+// hash table sizes observed in earlier runs of the plan that code is generated for (library mode, see Cardinalities)
+Cardinalities cardinalities;
+
+struct Operator;
+struct HashJoin;
+
+// reorder the tree of hash joins rooted at join by estimated cost (see JoinGraph); returns nullptr if it cannot be reordered
+unique_ptr<Operator> orderJoins(HashJoin& join, const IUSet& required, vector<unique_ptr<Exp>>& predicates);
+
+// optimize plan rooted at op, which has to provide 'required' IUs, and apply 'predicates' to its output (see Operator::optimize)
+unique_ptr<Operator> optimizePlan(unique_ptr<Operator> op, const IUSet& required, vector<unique_ptr<Exp>> predicates = {});
+
+// place selection applying the conjunction of predicates (if any) on top of op (optimizer helper)
+unique_ptr<Operator> applyPredicates(unique_ptr<Operator> op, vector<unique_ptr<Exp>> predicates);
+
 // abstract base class of all operators
 struct Operator {
    // compute *all* IUs this operator can produce
@@ -243,16 +1077,179 @@ struct Operator {
    // generate code for operator providing 'required' IUs and pushing them to 'consume' callback
    virtual void produce(const IUSet& required, ConsumerFn consume) = 0;
 
+   // push filter down to the scan that provides its keys; returns false if this is not possible
+   virtual bool pushDownFilter(const ScanFilter& filter) { return false; }
+
+   // push range predicate down to the scan that provides its IU, which skips blocks using zone maps
+   virtual bool pushDownRange(const Comparison& cmp) { return false; }
+
+   // canonical description of the plan rooted at this operator (before any push down)
+   virtual string fingerprint(Fingerprint& fp) = 0;
+
+   // rewrite the plan rooted at this operator (owned by self), which has to provide 'required' IUs, and apply the
+   // conjuncts of the selections above it ('predicates') as early as possible; returns the new root of the plan
+   virtual unique_ptr<Operator> optimize(unique_ptr<Operator> self, const IUSet& required, vector<unique_ptr<Exp>> predicates) { return applyPredicates(std::move(self), std::move(predicates)); }
+
+   // estimated number of tuples this operator produces (optimizer, requires statistics)
+   virtual double estimateCardinality() = 0;
+
+   // estimated number of distinct values of an IU this operator provides, nullopt if unknown (optimizer, requires statistics)
+   virtual optional<double> estimateDistinct(IU* iu) = 0;
+
+   // run operator with the interpreter providing 'required' IUs and pushing chunks to 'consume' callback
+   virtual void interpret(Interpreter& in, const IUSet& required, const ChunkConsumer& consume) = 0;
+
+#ifdef P2C_LLVM
+   // generate LLVM IR for operator providing 'required' IUs (in ir.values) and pushing them to 'consume' callback
+   virtual void produceIR(IRGen& ir, const IUSet& required, ConsumerFn consume) = 0;
+#endif
+
    // destructor
    virtual ~Operator() {}
 };
 
+// estimated number of distinct values of an IU op provides, at most its cardinality (optimizer helper)
+double distinctValues(Operator& op, IU* iu) {
+   double card = op.estimateCardinality();
+   return std::max(1.0, std::min(op.estimateDistinct(iu).value_or(card), card));
+}
+
+// id of the hash table that holds the output of op (see Cardinalities)
+uint64_t cardinalityId(Operator& op) {
+   Fingerprint fp;
+   return fnv1a(op.fingerprint(fp));
+}
+
+// expression for the expected size of the hash table that holds the output of op: the size observed in earlier runs
+// or, without feedback, the optimizer's estimate (at most the size of the largest relation, 0 without statistics)
+string genSizeHint(Operator& op) {
+   uint64_t estimate = 0;
+   if (statistics) {
+      double largest = 0;
+      for (auto& [relation, columns] : TPCH::schema)
+         largest = std::max<double>(largest, statistics->rowCount(relation));
+      estimate = llround(std::min(op.estimateCardinality(), largest));
+   }
+   uint64_t id = cardinalityId(op);
+   return format("cardinalities.hint({:#x}, {})", id, cardinalities.hint(id, estimate));
+}
+
+// push materialized rows (in order, if given) in chunks to 'consume' (interpreter helper)
+void emitRows(Interpreter& in, const vector<IU*>& ius, const vector<const ColumnBuffer*>& buffers, uint64_t n, const vector<uint64_t>* order, const ChunkConsumer& consume) {
+   // starts a pipeline
+   in.stopped = false;
+   for (uint64_t begin = 0; begin < n && !in.stopped; begin += Interpreter::chunkSize) {
+      Chunk chunk;
+      chunk.count = min<uint64_t>(n - begin, Interpreter::chunkSize);
+      for (unsigned i = 0; i != ius.size(); i++)
+         chunk.columns[ius[i]] = order ? gather(*buffers[i], order->data() + begin, chunk.count) : buffers[i]->view(begin);
+      consume(chunk);
+   }
+}
+
+// materialized input of Sort and TopK, ordered by the sort keys (interpreter helper)
+struct SortedRows {
+   vector<IU*> ius;
+   vector<ColumnBuffer> buffers;
+   vector<uint64_t> order;
+   // positions of the sort keys in ius
+   vector<unsigned> keyPositions;
+   vector<bool> ascending;
+
+   SortedRows(Interpreter& in, Operator& input, const IUSet& required, const vector<IU*>& keyIUs, const vector<bool>& ascending) : ascending(ascending) {
+      IUSet all = required | IUSet(keyIUs);
+      ius.assign(all.begin(), all.end());
+      for (IU* iu : ius)
+         buffers.emplace_back(iu->type);
+      for (IU* key : keyIUs)
+         keyPositions.push_back(find(ius.begin(), ius.end(), key) - ius.begin());
+      input.interpret(in, all, [&](Chunk& chunk) {
+         for (unsigned i = 0; i != ius.size(); i++)
+            buffers[i].append(chunk.columns.at(ius[i]), chunk.count);
+      });
+      order.resize(buffers.empty() ? 0 : buffers[0].size());
+      iota(order.begin(), order.end(), 0);
+   }
+
+   // order the first k rows (all rows if k is at least the row count)
+   void sort(uint64_t k) {
+      vector<RowCompareFn> cmps;
+      for (unsigned pos : keyPositions)
+         cmps.push_back(rowCompare(ius[pos]->type));
+      auto less = [&](uint64_t a, uint64_t b) {
+         for (unsigned i = 0; i != keyPositions.size(); i++)
+            if (int c = cmps[i](buffers[keyPositions[i]], a, b))
+               return ascending[i] ? c < 0 : c > 0;
+         return false;
+      };
+      if (k < order.size()) {
+         partial_sort(order.begin(), order.begin() + k, order.end(), less);
+         order.resize(k);
+      } else {
+         std::sort(order.begin(), order.end(), less);
+      }
+   }
+
+   void emit(Interpreter& in, const ChunkConsumer& consume) {
+      vector<const ColumnBuffer*> pointers;
+      for (auto& b : buffers)
+         pointers.push_back(&b);
+      emitRows(in, ius, pointers, order.size(), &order, consume);
+   }
+};
+
+#ifdef P2C_LLVM
+// generate code that materializes input, orders the first limit rows by the sort keys, and pushes them to 'consume' (LLVM helper of Sort and TopK)
+void genSortedIR(IRGen& ir, Operator& input, const IUSet& required, const vector<IU*>& keyIUs, const vector<bool>& ascending, uint64_t limit, ConsumerFn consume) {
+   IUSet all = required | IUSet(keyIUs);
+   IRRow row(all.v);
+   llvm::Value* table = ir.createTable(row.width);
+   input.produceIR(ir, all, [&]() {
+      llvm::Value* r = ir.call("p2cRowsAppend", ir.ptrType(), {table});
+      for (IU* iu : row.ius)
+         row.store(ir, r, iu, ir.values.at(iu));
+   });
+
+   // comparison function 'int32_t compare(const uint8_t* a, const uint8_t* b)' passed to the runtime
+   auto saved = ir.b.saveIP();
+   auto cmpType = llvm::FunctionType::get(ir.b.getInt32Ty(), {ir.ptrType(), ir.ptrType()}, false);
+   auto cmp = llvm::Function::Create(cmpType, llvm::Function::InternalLinkage, "compare", *ir.module);
+   ir.b.SetInsertPoint(llvm::BasicBlock::Create(*ir.context, "entry", cmp));
+   for (unsigned i = 0; i != keyIUs.size(); i++) {
+      IRValue a = {row.load(ir, cmp->getArg(0), keyIUs[i]), keyIUs[i]->type}, b = {row.load(ir, cmp->getArg(1), keyIUs[i]), keyIUs[i]->type};
+      llvm::Value* c = ascending[i] ? ir.compare3(a, b) : ir.compare3(b, a);
+      auto differs = ir.block("differs"), next = ir.block("next");
+      ir.b.CreateCondBr(ir.b.CreateICmpNE(c, ir.b.getInt32(0)), differs, next);
+      ir.b.SetInsertPoint(differs);
+      ir.b.CreateRet(c);
+      ir.b.SetInsertPoint(next);
+   }
+   ir.b.CreateRet(ir.b.getInt32(0));
+   ir.b.restoreIP(saved);
+
+   llvm::Value* n = ir.call("p2cRowsSort", ir.b.getInt64Ty(), {table, cmp, ir.b.getInt64(limit)});
+   ir.genLoop(n, [&](llvm::Value* i) {
+      llvm::Value* r = ir.call("p2cRowsSorted", ir.ptrType(), {table, i});
+      for (IU* iu : required)
+         ir.values[iu] = row.load(ir, r, iu);
+      consume();
+   });
+}
+#endif
+
 // table scan operator
 struct Scan : public Operator {
    // IU storage for all available attributes
    vector<IU> attributes;
    // relation name
    string relName;
+   // filters pushed down from joins
+   vector<ScanFilter> filters;
+   // range predicates pushed down from selections
+   vector<Comparison> ranges;
+   // generate pipeline in vectorized mode (batches of rows with selection vectors)
+   bool vectorized = defaultVectorized;
+   static inline bool defaultVectorized = false;
 
    // constructor
    Scan(const string& relName) : relName(relName) {
@@ -276,13 +1273,183 @@ struct Scan : public Operator {
       return result;
    }
 
-   void produce(const IUSet& required, ConsumerFn consume) override {
-      genBlock(format("for (uint64_t i = 0; i != db.{}.tupleCount; i++)", relName), [&]() {
+   double estimateCardinality() override { return statistics->rowCount(relName); }
+   optional<double> estimateDistinct(IU* iu) override { return statistics->distinctValues(relName, iu->name, iu->type); }
+
+   string fingerprint(Fingerprint& fp) override {
+      vector<string> strs;
+      for (auto& iu : attributes)
+         strs.push_back(iu.name + fp.iu(&iu));
+      return format("scan({},{},{})", relName, vectorized ? "vectorized" : "tuple", join(strs, ","));
+   }
+
+   void interpret(Interpreter& in, const IUSet& required, const ChunkConsumer& consume) override {
+      uint64_t n = in.db.tupleCount(relName, attributes[0].name, attributes[0].type);
+      // starts a pipeline
+      in.stopped = false;
+      for (uint64_t begin = 0; begin < n && !in.stopped; begin += Interpreter::chunkSize) {
+         Chunk chunk;
+         chunk.count = min<uint64_t>(n - begin, Interpreter::chunkSize);
          for (IU* iu : required)
-            provideIU(iu, format("db.{}.{}[i]", relName, iu->name));
+            chunk.columns[iu] = in.db.scan(relName, iu->name, iu->type, begin, chunk.count);
+         consume(chunk);
+      }
+   }
+
+#ifdef P2C_LLVM
+   void produceIR(IRGen& ir, const IUSet& required, ConsumerFn consume) override {
+      llvm::Value* n = ir.tupleCount(relName, attributes[0].name, attributes[0].type);
+      vector<llvm::Value*> columns;
+      for (IU* iu : required)
+         columns.push_back(ir.column(relName, iu->name, iu->type));
+      ir.genLoop(n, [&](llvm::Value* i) {
+         unsigned c = 0;
+         for (IU* iu : required)
+            ir.values[iu] = ir.load(columns[c++], iu->type, i);
          consume();
       });
    }
+#endif
+
+   void produce(const IUSet& required, ConsumerFn consume) override {
+      // split relation into morsels that are processed in parallel
+      if (!tieredPipelines) {
+         genPipeline(format("pool.parallelFor(db.{}.tupleCount, ", relName), [&]() {
+            produceMorsel(required, consume);
+         });
+         return;
+      }
+      // the morsel lambda is named, so the optimized build can call its own code for it
+      string morsel = IU::genVar("morsel");
+      genPipeline(format("auto {} = ", morsel), [&]() {
+         produceMorsel(required, consume);
+      }, ";");
+      print("tiering.parallelFor<tierTable, {}>(pool, db.{}.tupleCount, {});\n", tieredPipelineCount++, relName, morsel);
+   }
+
+   // generate body of the pipeline's morsel loop
+   void produceMorsel(const IUSet& required, ConsumerFn consume) {
+      // skip morsels whose blocks cannot contain qualifying tuples
+      for (auto& cmp : ranges)
+         genBlock(format("if (!db.{}.{}.mayMatch(begin, end, [&](const auto& min, const auto& max) {{ return {}; }}))", relName, cmp.iu->name, zoneCondition(cmp)), [&]() {
+            print("return;\n");
+         });
+      // filters are only checked as long as they filter well
+      vector<string> useFilter, checked, rejected;
+      for (auto& f : filters) {
+         useFilter.push_back(IU::genVar("useFilter"));
+         checked.push_back(IU::genVar("checked"));
+         rejected.push_back(IU::genVar("rejected"));
+         print("bool {} = {}.active();\n", useFilter.back(), f.varname);
+         print("uint64_t {} = 0, {} = 0;\n", checked.back(), rejected.back());
+      }
+      if (vectorized)
+         produceBatches(required, consume, useFilter, checked, rejected);
+      else
+         produceTuples(required, consume, useFilter, checked, rejected);
+      for (unsigned f = 0; f != filters.size(); f++)
+         genBlock(format("if ({})", useFilter[f]), [&]() {
+            print("{}.report({}, {});\n", filters[f].varname, checked[f], rejected[f]);
+         });
+   }
+
+   // generate tuple-at-a-time loop over a morsel
+   void produceTuples(const IUSet& required, ConsumerFn consume, const vector<string>& useFilter, const vector<string>& checked, const vector<string>& rejected) {
+      genBlock("for (uint64_t i = begin; i != end; i++)", [&]() {
+         // load filter keys first and skip tuples before the other attributes are loaded
+         IUSet provided;
+         for (unsigned f = 0; f != filters.size(); f++) {
+            for (IU* iu : filters[f].keyIUs)
+               if (!provided.contains(iu)) {
+                  provideIU(iu, format("db.{}.{}[i]", relName, iu->name));
+                  provided.add(iu);
+               }
+            genBlock(format("if ({})", useFilter[f]), [&]() {
+               print("{}++;\n", checked[f]);
+               genBlock(format("if (!{}.mayContain(hashKey(tuple<{}>{{{}}})))", filters[f].varname, filters[f].keyTypes, formatVarnames(filters[f].keyIUs)), [&]() {
+                  print("{}++;\n", rejected[f]);
+                  print("continue;\n");
+               });
+            });
+         }
+         for (IU* iu : required - provided)
+            provideIU(iu, format("db.{}.{}[i]", relName, iu->name));
+         consumeInPipeline(consume);
+      });
+   }
+
+   // generate loop over the batches of a morsel; downstream operators work on the batch's selection vector
+   void produceBatches(const IUSet& required, ConsumerFn consume, const vector<string>& useFilter, const vector<string>& checked, const vector<string>& rejected) {
+      genBlock(format("for (uint64_t batchBegin = begin; batchBegin < end; batchBegin += {})", Batch::size), [&]() {
+         Batch batch;
+         batch.sel = "sel";
+         batch.count = "count";
+         for (IU& iu : attributes) {
+            batch.columns[&iu] = [this, name = iu.name](const string& pos) { return format("db.{}.{}[batchBegin + {}]", relName, name, pos); };
+            if (iu.type != Type::String)
+               batch.arrays[&iu] = format("(db.{}.{}.data() + batchBegin)", relName, iu.name);
+         }
+         batch.dense = filters.empty();
+         print("uint32_t {} = std::min<uint64_t>(end - batchBegin, {});\n", batch.count, Batch::size);
+         print("uint32_t {}[{}];\n", batch.sel, Batch::size);
+         genBlock(format("for (uint32_t k = 0; k != {}; k++)", batch.count), [&]() {
+            print("{}[k] = k;\n", batch.sel);
+         });
+         // Bloom filters reduce the selection vector
+         for (unsigned f = 0; f != filters.size(); f++) {
+            genBlock(format("if ({})", useFilter[f]), [&]() {
+               print("uint32_t selected = 0;\n");
+               genBlock(format("for (uint32_t k = 0; k != {}; k++)", batch.count), [&]() {
+                  print("uint32_t pos = {}[k];\n", batch.sel);
+                  batch.provide(IUSet(filters[f].keyIUs), "pos");
+                  print("{}[selected] = pos;\n", batch.sel);
+                  print("selected += {}.mayContain(hashKey(tuple<{}>{{{}}}));\n", filters[f].varname, filters[f].keyTypes, formatVarnames(filters[f].keyIUs));
+               });
+               print("{} += {};\n", checked[f], batch.count);
+               print("{} += {} - selected;\n", rejected[f], batch.count);
+               print("{} = selected;\n", batch.count);
+            });
+         }
+         currentBatch = &batch;
+         consumeInPipeline(consume);
+         currentBatch = nullptr;
+      });
+   }
+
+   bool pushDownFilter(const ScanFilter& filter) override {
+      for (IU* iu : filter.keyIUs)
+         if (!availableIUs().contains(iu))
+            return false;
+      // pipelines may be generated more than once (e.g., the build side of a JoinStrategy::Auto join)
+      for (auto& f : filters)
+         if (f.varname == filter.varname)
+            return true;
+      filters.push_back(filter);
+      return true;
+   }
+
+   bool pushDownRange(const Comparison& cmp) override {
+      if (!availableIUs().contains(cmp.iu) || cmp.iu->type == Type::String)
+         return false;
+      // pipelines may be generated more than once (e.g., for JoinStrategy::Auto)
+      for (auto& r : ranges)
+         if (r.iu == cmp.iu && r.op == cmp.op && r.constant == cmp.constant)
+            return true;
+      ranges.push_back(cmp);
+      return true;
+   }
+
+   // generate condition on a block's min/max under which it may contain qualifying rows (helper)
+   static string zoneCondition(const Comparison& cmp) {
+      const string& c = cmp.constant;
+      if (cmp.op == "Eq")
+         return format("min <= {} && max >= {}", c, c);
+      if (cmp.op == "Ne")
+         return format("!(min == {} && max == {})", c, c);
+      if (cmp.op == "Lt" || cmp.op == "Le")
+         return format("min {} {}", cmp.op == "Lt" ? "<" : "<=", c);
+      return format("max {} {}", cmp.op == "Gt" ? ">" : ">=", c);
+   }
 
    IU* getIU(const string& attName) {
       for (IU& iu : attributes)
@@ -305,15 +1472,209 @@ struct Selection : public Operator {
 
    IUSet availableIUs() override { return input->availableIUs(); }
 
-   void produce(const IUSet& required, ConsumerFn consume) override {
-      input->produce(required | pred->iusUsed(), [&]() {
-         genBlock(format("if ({})", pred->compile()), [&]() {
-            consume();
+   // conjuncts are independent; other conjuncts than comparisons with a constant keep half of the tuples
+   double estimateCardinality() override {
+      vector<Exp*> conjuncts;
+      splitConjunction(pred.get(), conjuncts);
+      double result = input->estimateCardinality();
+      for (Exp* exp : conjuncts) {
+         auto cmp = matchComparison(exp);
+         result *= cmp ? selectivity(*cmp) : 0.5;
+      }
+      return result;
+   }
+
+   // fraction of the tuples that satisfy a comparison: from the histogram and most common values of a column if there
+   // are statistics files, otherwise '=' keeps 1/(distinct values), '!=' the rest, and ranges a third
+   double selectivity(const Comparison& cmp) {
+      auto relation = statistics->relationOf(cmp.iu->name, cmp.iu->type);
+      auto value = cmp.value->constantValue();
+      if (relation && value && input->estimateDistinct(cmp.iu))
+         if (auto fraction = statistics->selectivity(*relation, cmp.iu->name, cmp.iu->type, cmp.op, *value))
+            return *fraction;
+      if (cmp.op == "Eq")
+         return 1 / distinctValues(*input, cmp.iu);
+      if (cmp.op == "Ne")
+         return 1 - 1 / distinctValues(*input, cmp.iu);
+      return 1.0 / 3;
+   }
+   optional<double> estimateDistinct(IU* iu) override { return input->estimateDistinct(iu); }
+
+   bool pushDownFilter(const ScanFilter& filter) override { return input->pushDownFilter(filter); }
+   bool pushDownRange(const Comparison& cmp) override { return input->pushDownRange(cmp); }
+
+   string fingerprint(Fingerprint& fp) override {
+      string in = input->fingerprint(fp);
+      return format("select({},{})", in, pred->fingerprint(fp));
+   }
+
+   // the conjuncts are pushed down with those of the selections above; conjuncts that are always true are dropped
+   unique_ptr<Operator> optimize(unique_ptr<Operator> self, const IUSet& required, vector<unique_ptr<Exp>> predicates) override {
+      foldConstants(pred);
+      takeConjuncts(std::move(pred), predicates);
+      erase_if(predicates, [](auto& exp) {
+         auto value = exp->constantValue();
+         return value && value->type == Type::Bool && value->template at<bool>(0);
+      });
+      return optimizePlan(std::move(input), required, std::move(predicates));
+   }
+
+   void interpret(Interpreter& in, const IUSet& required, const ChunkConsumer& consume) override {
+      vector<Exp*> conjuncts;
+      splitConjunction(pred.get(), conjuncts);
+      vector<uint32_t> sel;
+      input->interpret(in, required | pred->iusUsed(), [&](Chunk& chunk) {
+         // each conjunct reduces the selection vector
+         sel.resize(chunk.count);
+         uint32_t count = chunk.count;
+         bool dense = true;
+         for (Exp* exp : conjuncts) {
+            auto fn = dynamic_cast<FnExp*>(exp);
+            if (fn && FnExp::comparison(fn->fnName)) {
+               auto [a, b] = fn->evaluateArgs(in, chunk);
+               count = select(*FnExp::comparison(fn->fnName), a, b, sel.data(), count, dense);
+            } else {
+               count = selectTrue(exp->evaluate(in, chunk), sel.data(), count, dense);
+            }
+            dense = false;
+            if (!count)
+               return;
+         }
+         if (count == chunk.count) {
+            consume(chunk);
+            return;
+         }
+         Chunk out;
+         out.count = count;
+         for (IU* iu : required)
+            out.columns[iu] = gather(chunk.columns.at(iu), sel.data(), count);
+         consume(out);
+      });
+   }
+
+#ifdef P2C_LLVM
+   void produceIR(IRGen& ir, const IUSet& required, ConsumerFn consume) override {
+      input->produceIR(ir, required | pred->iusUsed(), [&]() { ir.genIf(pred->compileIR(ir).value, consume); });
+   }
+#endif
+
+   void produce(const IUSet& required, ConsumerFn consume) override {
+      // let scans skip blocks; the predicate is still evaluated here
+      vector<Exp*> conjuncts;
+      splitConjunction(pred.get(), conjuncts);
+      for (Exp* exp : conjuncts)
+         if (auto cmp = matchComparison(exp))
+            input->pushDownRange(*cmp);
+      input->produce(required | pred->iusUsed(), [&]() {
+         if (currentBatch) {
+            produceBatch(*currentBatch);
+            consume();
+            return;
+         }
+         genBlock(format("if ({})", pred->compile()), [&]() {
+            consume();
          });
       });
    }
+
+   // split conjunction into its conjuncts (helper)
+   static void splitConjunction(Exp* exp, vector<Exp*>& conjuncts) {
+      auto fn = dynamic_cast<FnExp*>(exp);
+      if (fn && fn->fnName == "std::logical_and()") {
+         for (auto& arg : fn->args)
+            splitConjunction(arg.get(), conjuncts);
+      } else {
+         conjuncts.push_back(exp);
+      }
+   }
+
+   // split conjunction into its conjuncts, taking ownership of them (optimizer helper)
+   static void takeConjuncts(unique_ptr<Exp> exp, vector<unique_ptr<Exp>>& conjuncts) {
+      auto fn = dynamic_cast<FnExp*>(exp.get());
+      if (fn && fn->fnName == "std::logical_and()") {
+         for (auto& arg : fn->args)
+            takeConjuncts(std::move(arg), conjuncts);
+      } else {
+         conjuncts.push_back(std::move(exp));
+      }
+   }
+
+   // generate SIMD kernel call if the predicate compares an array of the batch with a constant (helper)
+   static bool genKernel(Exp* exp, Batch& batch) {
+      auto cmp = matchComparison(exp);
+      if (!cmp || !batch.arrays.contains(cmp->iu) || cmp->iu->type == Type::Bool)
+         return false;
+      string array = batch.arrays.at(cmp->iu);
+      if (batch.dense)
+         print("{} = selectDense<CmpOp::{}>({}, {}, {}, {});\n", batch.count, cmp->op, array, batch.count, cmp->constant, batch.sel);
+      else
+         print("{} = selectSparse<CmpOp::{}>({}, {}, {}, {});\n", batch.count, cmp->op, array, batch.sel, batch.count, cmp->constant);
+      batch.dense = false;
+      return true;
+   }
+
+   // reduce the selection vector of a batch
+   void produceBatch(Batch& batch) {
+      // column-constant comparisons are evaluated by SIMD kernels, the rest in a branch-free loop
+      vector<Exp*> conjuncts, rest;
+      splitConjunction(pred.get(), conjuncts);
+      for (Exp* exp : conjuncts)
+         if (!genKernel(exp, batch))
+            rest.push_back(exp);
+      if (rest.empty())
+         return;
+      IUSet ius;
+      vector<string> preds;
+      for (Exp* exp : rest) {
+         for (IU* iu : exp->iusUsed())
+            ius.add(iu);
+         preds.push_back(exp->compile());
+      }
+      genBlock("", [&]() {
+         print("uint32_t selected = 0;\n");
+         genBlock(format("for (uint32_t k = 0; k != {}; k++)", batch.count), [&]() {
+            print("uint32_t pos = {}[k];\n", batch.sel);
+            batch.provide(ius, "pos");
+            print("{}[selected] = pos;\n", batch.sel);
+            print("selected += {};\n", join(preds, " && "));
+         });
+         print("{} = selected;\n", batch.count);
+      });
+      batch.dense = false;
+   }
 };
 
+unique_ptr<Operator> applyPredicates(unique_ptr<Operator> op, vector<unique_ptr<Exp>> predicates) {
+   if (predicates.empty())
+      return op;
+   unique_ptr<Exp> pred = std::move(predicates[0]);
+   for (size_t i = 1; i != predicates.size(); i++) {
+      vector<unique_ptr<Exp>> args;
+      args.push_back(std::move(pred));
+      args.push_back(std::move(predicates[i]));
+      pred = make_unique<FnExp>("std::logical_and()", std::move(args));
+   }
+   return make_unique<Selection>(std::move(op), std::move(pred));
+}
+
+// remove the predicates that can be applied to an input providing 'available' IUs from predicates (optimizer helper)
+vector<unique_ptr<Exp>> extractPredicates(vector<unique_ptr<Exp>>& predicates, const IUSet& available) {
+   vector<unique_ptr<Exp>> result, rest;
+   for (auto& exp : predicates)
+      ((exp->iusUsed() - available).size() ? rest : result).push_back(std::move(exp));
+   predicates = std::move(rest);
+   return result;
+}
+
+// set of all IUs used in expressions (optimizer helper)
+IUSet iusUsed(const vector<unique_ptr<Exp>>& exps) {
+   IUSet result;
+   for (auto& exp : exps)
+      for (IU* iu : exp->iusUsed())
+         result.add(iu);
+   return result;
+}
+
 // map operator (compute new value)
 struct Map : public Operator {
    unique_ptr<Operator> input;
@@ -329,8 +1690,68 @@ struct Map : public Operator {
 
    IUSet availableIUs() override { return input->availableIUs() | IUSet({&iu}); }
 
+   double estimateCardinality() override { return input->estimateCardinality(); }
+   optional<double> estimateDistinct(IU* x) override { return x == &iu ? nullopt : input->estimateDistinct(x); }
+
+   bool pushDownFilter(const ScanFilter& filter) override {
+      for (IU* key : filter.keyIUs)
+         if (key == &iu)
+            return false;
+      return input->pushDownFilter(filter);
+   }
+
+   bool pushDownRange(const Comparison& cmp) override { return cmp.iu != &iu && input->pushDownRange(cmp); }
+
+   string fingerprint(Fingerprint& fp) override {
+      string in = input->fingerprint(fp);
+      string e = exp->fingerprint(fp);
+      return format("map({},{}={})", in, fp.iu(&iu), e);
+   }
+
+   // the map is dropped if nothing uses its value; predicates that do not use it are pushed below it
+   unique_ptr<Operator> optimize(unique_ptr<Operator> self, const IUSet& required, vector<unique_ptr<Exp>> predicates) override {
+      if (!(required | iusUsed(predicates)).contains(&iu))
+         return optimizePlan(std::move(input), required, std::move(predicates));
+      foldConstants(exp);
+      auto below = extractPredicates(predicates, input->availableIUs());
+      input = optimizePlan(std::move(input), (required | iusUsed(predicates) | exp->iusUsed()) - IUSet({&iu}), std::move(below));
+      return applyPredicates(std::move(self), std::move(predicates));
+   }
+
+   void interpret(Interpreter& in, const IUSet& required, const ChunkConsumer& consume) override {
+      input->interpret(in, (required | exp->iusUsed()) - IUSet({&iu}), [&](Chunk& chunk) {
+         chunk.columns[&iu] = cast(exp->evaluate(in, chunk), iu.type, chunk.count);
+         consume(chunk);
+      });
+   }
+
+#ifdef P2C_LLVM
+   void produceIR(IRGen& ir, const IUSet& required, ConsumerFn consume) override {
+      input->produceIR(ir, (required | exp->iusUsed()) - IUSet({&iu}), [&]() {
+         ir.values[&iu] = ir.cast(exp->compileIR(ir), iu.type).value;
+         consume();
+      });
+   }
+#endif
+
    void produce(const IUSet& required, ConsumerFn consume) override {
       input->produce((required | exp->iusUsed()) - IUSet({&iu}), [&]() {
+         if (currentBatch) {
+            // compute value for all selected rows in a tight loop
+            Batch* batch = currentBatch;
+            string vec = format("{}Batch", iu.varname);
+            print("{} {}[{}];\n", tname(iu.type), vec, Batch::size);
+            genBlock(format("for (uint32_t k = 0; k != {}; k++)", batch->count), [&]() {
+               print("uint32_t pos = {}[k];\n", batch->sel);
+               batch->provide(exp->iusUsed(), "pos");
+               print("{}[pos] = {};\n", vec, exp->compile());
+            });
+            batch->columns[&iu] = [vec](const string& pos) { return format("{}[{}]", vec, pos); };
+            if (iu.type != Type::String)
+               batch->arrays[&iu] = vec;
+            consume();
+            return;
+         }
          genBlock("", [&]() {
             provideIU(&iu, exp->compile());
             consume();
@@ -350,7 +1771,7 @@ struct Sort : public Operator {
    unique_ptr<Operator> input;
    vector<IU*> keyIUs;
    vector<bool> ascending;
-   IU v{"vector", Type::Undefined};
+   IU v{"sorter", Type::Undefined};
    IU cmp{"custom_cmp", Type::Undefined};
 
    // constructor
@@ -361,6 +1782,30 @@ struct Sort : public Operator {
 
    IUSet availableIUs() override { return input->availableIUs(); }
 
+   double estimateCardinality() override { return input->estimateCardinality(); }
+   optional<double> estimateDistinct(IU* iu) override { return input->estimateDistinct(iu); }
+
+   string fingerprint(Fingerprint& fp) override {
+      string in = input->fingerprint(fp);
+      return format("sort({},{})", in, fp.sortKeys(keyIUs, ascending));
+   }
+
+   // filtering does not change the order, so all predicates are pushed below the sort
+   unique_ptr<Operator> optimize(unique_ptr<Operator> self, const IUSet& required, vector<unique_ptr<Exp>> predicates) override {
+      input = optimizePlan(std::move(input), required | IUSet(keyIUs), std::move(predicates));
+      return self;
+   }
+
+   void interpret(Interpreter& in, const IUSet& required, const ChunkConsumer& consume) override {
+      SortedRows rows(in, *input, required, keyIUs, ascending);
+      rows.sort(rows.order.size());
+      rows.emit(in, consume);
+   }
+
+#ifdef P2C_LLVM
+   void produceIR(IRGen& ir, const IUSet& required, ConsumerFn consume) override { genSortedIR(ir, *input, required, keyIUs, ascending, ~0ull, consume); }
+#endif
+
    void produce(const IUSet& required, ConsumerFn consume) override {
       // compute IUs
       IUSet restIUs = required - IUSet(keyIUs);
@@ -381,23 +1826,222 @@ struct Sort : public Operator {
       });
       print("{};\n", cmp.varname);
 
-      // collect tuples
-      print("vector<tuple<{}>> {};\n", formatTypes(allIUs), v.varname);
-      input->produce(IUSet(allIUs), [&]() {
-         print("{}.push_back({{{}}});\n", v.varname, formatVarnames(allIUs));
+      // layout of the normalized key (offsets are C++ expressions, string prefix width is defined in sort.hpp); it ends
+      // with the first string key, as equal prefixes do not order the strings and the comparator decides from there
+      vector<string> offsets;
+      string keyBytes = "0";
+      bool exact = true;
+      for (IU* iu : keyIUs) {
+         offsets.push_back(keyBytes);
+         string width = iu->type == Type::String ? "stringKeyPrefix" : format("sizeof({})", tname(iu->type));
+         keyBytes += " + " + width;
+         if (iu->type == Type::String) {
+            exact = false;
+            break;
+         }
+      }
+
+      // collect tuples in thread-local vectors
+      genState(v.varname, [&]() { print("ParallelSort<tuple<{}>, {}> {}{{pool.size()}};\n", formatTypes(allIUs), keyBytes, v.varname); });
+      input->produce(IUSet(allIUs), tupleAtATime(IUSet(allIUs), [&]() {
+         print("{}.local().push_back({{{}}});\n", v.varname, formatVarnames(allIUs));
+      }));
+
+      // sort runs on normalized keys and merge them in parallel
+      genLambda(format("{}.sort(pool, ", v.varname), format("const tuple<{}>& t, uint8_t* key", formatTypes(allIUs)), [&]() {
+         for (unsigned i = 0; i != offsets.size(); i++) {
+            print("encodeKey(get<{}>(t), key + {});\n", i, offsets[i]);
+            if (!ascending[i])
+               print("invertKey(key + {}, {});\n", offsets[i], keyIUs[i]->type == Type::String ? "stringKeyPrefix" : format("sizeof({})", tname(keyIUs[i]->type)));
+         }
+      }, format(", {}, {}", cmp.varname, exact ? "true" : "false"));
+
+      // iterate
+      genBlock(format("for (auto* row : {}.sorted())", v.varname), [&]() {
+         print("auto& t = *row;\n");
+         for (unsigned i = 0; i < allIUs.size(); i++)
+            if (required.contains(allIUs[i]))
+               provideIU(allIUs[i], format("get<{}>(t)", i));
+         consumeInPipeline(consume);
+      });
+   };
+};
+
+// limit operator: passes on the first n tuples its input produces
+struct Limit : public Operator {
+   unique_ptr<Operator> input;
+   uint64_t n;
+   IU counter{"limitCount", Type::Undefined};
+   IU stop{"limitStop", Type::Undefined};
+
+   // constructor
+   Limit(unique_ptr<Operator> input, uint64_t n) : input(std::move(input)), n(n) {}
+
+   // destructor
+   ~Limit() {}
+
+   IUSet availableIUs() override { return input->availableIUs(); }
+
+   double estimateCardinality() override { return std::min<double>(n, input->estimateCardinality()); }
+   optional<double> estimateDistinct(IU* iu) override { return input->estimateDistinct(iu); }
+
+   string fingerprint(Fingerprint& fp) override { return format("limit({},{})", input->fingerprint(fp), n); }
+
+   unique_ptr<Operator> optimize(unique_ptr<Operator> self, const IUSet& required, vector<unique_ptr<Exp>> predicates) override {
+      input = optimizePlan(std::move(input), required);
+      return applyPredicates(std::move(self), std::move(predicates));
+   }
+
+   void interpret(Interpreter& in, const IUSet& required, const ChunkConsumer& consume) override {
+      uint64_t produced = 0;
+      input->interpret(in, required, [&](Chunk& chunk) {
+         if (produced >= n)
+            return;
+         // only the first count rows of a chunk are used
+         chunk.count = min<uint64_t>(chunk.count, n - produced);
+         produced += chunk.count;
+         if (produced >= n)
+            in.stopped = true;
+         consume(chunk);
+      });
+   }
+
+#ifdef P2C_LLVM
+   void produceIR(IRGen& ir, const IUSet& required, ConsumerFn consume) override {
+      llvm::Value* produced = ir.local(ir.b.getInt64Ty());
+      ir.b.CreateStore(ir.b.getInt64(0), produced);
+      input->produceIR(ir, required, [&]() {
+         llvm::Value* count = ir.b.CreateLoad(ir.b.getInt64Ty(), produced);
+         ir.genIf(ir.b.CreateICmpULT(count, ir.b.getInt64(n)), [&]() {
+            count = ir.b.CreateAdd(count, ir.b.getInt64(1));
+            ir.b.CreateStore(count, produced);
+            // stop the pipeline once n tuples are produced
+            ir.genIf(ir.b.CreateICmpEQ(count, ir.b.getInt64(n)), [&]() { ir.b.CreateStore(ir.b.getTrue(), ir.stop); });
+            consume();
+         });
       });
+   }
+#endif
+
+   void produce(const IUSet& required, ConsumerFn consume) override {
+      genState(counter.varname, [&]() {
+         print("atomic<uint64_t> {}{{0}};\n", counter.varname);
+         print("atomic<bool> {}{{false}};\n", stop.varname);
+      });
+      input->produce(required, tupleAtATime(required, [&]() {
+         genBlock("", [&]() {
+            print("uint64_t idx = {}.fetch_add(1, memory_order_relaxed);\n", counter.varname);
+            genBlock(format("if (idx < {})", n), [&]() {
+               consume();
+            });
+            // stop the pipeline: the current loop and all remaining morsels
+            genBlock(format("if (idx + 1 >= {})", n), [&]() {
+               print("{}.store(true, memory_order_relaxed);\n", stop.varname);
+               print("pool.stop();\n");
+            });
+         });
+         if (currentPipeline)
+            currentPipeline->stopFlags.push_back(stop.varname);
+      }));
+   }
+};
+
+// top-k operator: the first k tuples in sort order, without sorting the whole input
+struct TopK : public Operator {
+   unique_ptr<Operator> input;
+   vector<IU*> keyIUs;
+   vector<bool> ascending;
+   uint64_t k;
+   IU v{"topK", Type::Undefined};
+   IU heaps{"topKHeaps", Type::Undefined};
+   IU cmp{"topK_cmp", Type::Undefined};
+
+   // constructor
+   TopK(unique_ptr<Operator> input, const vector<IU*>& keyIUs, const vector<bool> ascending, uint64_t k)
+       : input(std::move(input)), keyIUs(keyIUs), ascending(ascending), k(k) {
+      assert(k > 0);
+   }
+
+   // destructor
+   ~TopK() {}
+
+   IUSet availableIUs() override { return input->availableIUs(); }
+
+   double estimateCardinality() override { return std::min<double>(k, input->estimateCardinality()); }
+   optional<double> estimateDistinct(IU* iu) override { return input->estimateDistinct(iu); }
+
+   string fingerprint(Fingerprint& fp) override {
+      string in = input->fingerprint(fp);
+      return format("topk({},{},{})", in, fp.sortKeys(keyIUs, ascending), k);
+   }
+
+   unique_ptr<Operator> optimize(unique_ptr<Operator> self, const IUSet& required, vector<unique_ptr<Exp>> predicates) override {
+      input = optimizePlan(std::move(input), required | IUSet(keyIUs));
+      return applyPredicates(std::move(self), std::move(predicates));
+   }
+
+   void interpret(Interpreter& in, const IUSet& required, const ChunkConsumer& consume) override {
+      SortedRows rows(in, *input, required, keyIUs, ascending);
+      rows.sort(k);
+      rows.emit(in, consume);
+   }
 
-      // sort
+#ifdef P2C_LLVM
+   void produceIR(IRGen& ir, const IUSet& required, ConsumerFn consume) override { genSortedIR(ir, *input, required, keyIUs, ascending, k, consume); }
+#endif
+
+   void produce(const IUSet& required, ConsumerFn consume) override {
+      // compute IUs (keys first, so the comparator also works on key-only tuples)
+      IUSet restIUs = required - IUSet(keyIUs);
+      vector<IU*> allIUs = keyIUs;
+      allIUs.insert(allIUs.end(), restIUs.v.begin(), restIUs.v.end());
+
+      // define custom comparator: is lhs before rhs in sort order?
+      // (a generic lambda, as local classes cannot have member templates; static, so it can also be a member of QueryState)
+      genState(cmp.varname, [&]() {
+         print("static constexpr auto {} = [](const auto& lhs, const auto& rhs) {{\n", cmp.varname);
+         for (size_t i = 0; i != keyIUs.size(); i++)
+            print("if (get<{0}>(lhs) != get<{0}>(rhs)) return get<{0}>(lhs) {1} get<{0}>(rhs);\n", i, ascending[i] ? "<" : ">");
+         print("return false;\n");
+         print("}};\n");
+      });
+
+      // each thread keeps a max-heap of its best k tuples
+      genState(heaps.varname, [&]() { print("PerWorker<vector<tuple<{}>>> {}{{pool.size()}};\n", formatTypes(allIUs), heaps.varname); });
+      input->produce(IUSet(allIUs), tupleAtATime(IUSet(allIUs), [&]() {
+         genBlock("", [&]() {
+            print("auto& heap = {}.local();\n", heaps.varname);
+            genBlock(format("if (heap.size() < {})", k), [&]() {
+               print("heap.push_back({{{}}});\n", formatVarnames(allIUs));
+               print("push_heap(heap.begin(), heap.end(), {});\n", cmp.varname);
+            });
+            // prune tuples that are not better than the worst one in the heap
+            genBlock(format("else if ({}(tuple<{}>{{{}}}, heap.front()))", cmp.varname, formatTypes(keyIUs), formatVarnames(keyIUs)), [&]() {
+               print("pop_heap(heap.begin(), heap.end(), {});\n", cmp.varname);
+               print("heap.back() = {{{}}};\n", formatVarnames(allIUs));
+               print("push_heap(heap.begin(), heap.end(), {});\n", cmp.varname);
+            });
+         });
+      }));
+
+      // merge thread-local heaps, sort, and keep the first k
+      print("vector<tuple<{}>> {};\n", formatTypes(allIUs), v.varname);
+      genBlock(format("for (auto& heap : {})", heaps.varname), [&]() {
+         print("{}.insert({}.end(), heap.begin(), heap.end());\n", v.varname, v.varname);
+      });
       print("sort({0}.begin(), {0}.end(), {1});\n", v.varname, cmp.varname);
+      genBlock(format("if ({}.size() > {})", v.varname, k), [&]() {
+         print("{}.resize({});\n", v.varname, k);
+      });
 
       // iterate
       genBlock(format("for (auto& t : {})", v.varname), [&]() {
          for (unsigned i = 0; i < allIUs.size(); i++)
             if (required.contains(allIUs[i]))
                provideIU(allIUs[i], format("get<{}>(t)", i));
-         consume();
+         consumeInPipeline(consume);
       });
-   };
+   }
 };
 
 // abstract base class for aggregate functions using in group by
@@ -412,32 +2056,73 @@ struct Aggregate {
 
    virtual string genInitValue() = 0;
    virtual string genUpdate(string oldValueRef) = 0;
+   // combine two partial aggregates (e.g., from different threads)
+   virtual string genMerge(string oldValueRef, string otherValueRef) = 0;
+   // canonical description of the aggregate function and its result
+   virtual string fingerprint(Fingerprint& fp) = 0;
+   // aggregate function of the interpreter
+   virtual AggFn aggFn() = 0;
+#ifdef P2C_LLVM
+   // LLVM IR of the initial value of a group and of updating the value old
+   virtual llvm::Value* genInitIR(IRGen& ir) = 0;
+   virtual llvm::Value* genUpdateIR(IRGen& ir, llvm::Value* old) = 0;
+#endif
 };
 
 struct CountAggregate final : Aggregate {
    CountAggregate(string name) : Aggregate(name, Type::Integer) {}
+   string fingerprint(Fingerprint& fp) override { return format("{}=count()", fp.iu(&resultIU)); }
+   AggFn aggFn() override { return AggFn::Count; }
+#ifdef P2C_LLVM
+   llvm::Value* genInitIR(IRGen& ir) override { return ir.b.getInt32(1); }
+   llvm::Value* genUpdateIR(IRGen& ir, llvm::Value* old) override { return ir.b.CreateAdd(old, ir.b.getInt32(1)); }
+#endif
    string genInitValue() override { return "1"; }
    string genUpdate(string oldValueRef) override { 
       return format("{} += 1", oldValueRef); 
    }
+   string genMerge(string oldValueRef, string otherValueRef) override {
+      return format("{} += {}", oldValueRef, otherValueRef);
+   }
 };
 
 struct MinAggregate final : Aggregate {
    MinAggregate(string name, IU* _inputIU) : Aggregate(name, _inputIU) {}
+   string fingerprint(Fingerprint& fp) override { return format("{}=min({})", fp.iu(&resultIU), fp.iu(inputIU)); }
+   AggFn aggFn() override { return AggFn::Min; }
+#ifdef P2C_LLVM
+   llvm::Value* genInitIR(IRGen& ir) override { return ir.values.at(inputIU); }
+   llvm::Value* genUpdateIR(IRGen& ir, llvm::Value* old) override {
+      llvm::Value* v = ir.values.at(inputIU);
+      return ir.b.CreateSelect(ir.compare(CmpOp::Lt, {v, inputIU->type}, {old, inputIU->type}), v, old);
+   }
+#endif
 
    string genInitValue() override { return format("{}", inputIU->varname); }
    string genUpdate(string oldValueRef) override {
       return format("{} = std::min({}, {})", oldValueRef, oldValueRef, inputIU->varname);
    }
+   string genMerge(string oldValueRef, string otherValueRef) override {
+      return format("{} = std::min({}, {})", oldValueRef, oldValueRef, otherValueRef);
+   }
 };
 
 struct SumAggregate final : Aggregate {
    SumAggregate(string name, IU* _inputIU) : Aggregate(name, _inputIU) {}
+   string fingerprint(Fingerprint& fp) override { return format("{}=sum({})", fp.iu(&resultIU), fp.iu(inputIU)); }
+   AggFn aggFn() override { return AggFn::Sum; }
+#ifdef P2C_LLVM
+   llvm::Value* genInitIR(IRGen& ir) override { return ir.values.at(inputIU); }
+   llvm::Value* genUpdateIR(IRGen& ir, llvm::Value* old) override { return ir.binary(BinaryOp::Plus, {old, resultIU.type}, {ir.values.at(inputIU), inputIU->type}).value; }
+#endif
 
    string genInitValue() override { return format("{}", inputIU->varname); }
    string genUpdate(string oldValueRef) override { 
       return format("{} += {}", oldValueRef, inputIU->varname);
    }
+   string genMerge(string oldValueRef, string otherValueRef) override {
+      return format("{} += {}", oldValueRef, otherValueRef);
+   }
 };
 
 // group by operator
@@ -472,42 +2157,158 @@ struct GroupBy : public Operator {
 
    IUSet availableIUs() override { return groupKeyIUs | IUSet(resultIUs()); }
 
+   // one group per combination of key values that occurs in the input
+   double estimateCardinality() override {
+      double groups = 1;
+      for (IU* iu : groupKeyIUs)
+         groups *= distinctValues(*input, iu);
+      return std::min(groups, input->estimateCardinality());
+   }
+   optional<double> estimateDistinct(IU* iu) override { return groupKeyIUs.contains(iu) ? input->estimateDistinct(iu) : nullopt; }
+
+   string fingerprint(Fingerprint& fp) override {
+      string in = input->fingerprint(fp);
+      vector<string> strs;
+      for (auto& agg : aggs)
+         strs.push_back(agg->fingerprint(fp));
+      return format("groupby({},[{}],[{}])", in, fp.ius(groupKeyIUs), join(strs, ","));
+   }
+
+   // predicates on group keys remove whole groups, so they are pushed below the aggregation
+   unique_ptr<Operator> optimize(unique_ptr<Operator> self, const IUSet& required, vector<unique_ptr<Exp>> predicates) override {
+      input = optimizePlan(std::move(input), groupKeyIUs | inputIUs(), extractPredicates(predicates, groupKeyIUs));
+      return applyPredicates(std::move(self), std::move(predicates));
+   }
+
+   void interpret(Interpreter& in, const IUSet& required, const ChunkConsumer& consume) override {
+      vector<IU*> keys(groupKeyIUs.begin(), groupKeyIUs.end());
+      vector<Type> keyTypes;
+      for (IU* key : keys)
+         keyTypes.push_back(key->type);
+      GroupTable table(keyTypes);
+      vector<ColumnBuffer> states;
+      for (auto& agg : aggs)
+         states.emplace_back(agg->resultIU.type);
+      vector<uint64_t> hashes;
+      vector<uint32_t> groups, created;
+      input->interpret(in, groupKeyIUs | inputIUs(), [&](Chunk& chunk) {
+         hashes.assign(chunk.count, 0);
+         groups.resize(chunk.count);
+         vector<Vector> keyVectors;
+         for (unsigned k = 0; k != keys.size(); k++) {
+            keyVectors.push_back(chunk.columns.at(keys[k]));
+            hashValues(keyVectors.back(), chunk.count, hashes.data(), k == 0);
+         }
+         table.findOrInsert(keyVectors, hashes.data(), chunk.count, groups.data(), created);
+         for (unsigned a = 0; a != aggs.size(); a++) {
+            Vector values = aggs[a]->inputIU ? cast(chunk.columns.at(aggs[a]->inputIU), states[a].type, chunk.count) : Vector{};
+            aggregate(aggs[a]->aggFn(), states[a], values, groups.data(), chunk.count, created, table.groupCount());
+         }
+      });
+      // output groups
+      vector<IU*> ius = keys;
+      vector<const ColumnBuffer*> buffers;
+      for (auto& key : table.keys)
+         buffers.push_back(&key);
+      for (unsigned a = 0; a != aggs.size(); a++) {
+         ius.push_back(&aggs[a]->resultIU);
+         buffers.push_back(&states[a]);
+      }
+      emitRows(in, ius, buffers, table.groupCount(), nullptr, consume);
+   }
+
+#ifdef P2C_LLVM
+   void produceIR(IRGen& ir, const IUSet& required, ConsumerFn consume) override {
+      vector<IU*> keys(groupKeyIUs.begin(), groupKeyIUs.end()), stored = keys;
+      for (auto& agg : aggs)
+         stored.push_back(&agg->resultIU);
+      IRRow row(stored);
+      llvm::Value* table = ir.createTable(row.width);
+      input->produceIR(ir, groupKeyIUs | inputIUs(), [&]() {
+         vector<IRValue> keyValues;
+         for (IU* key : keys)
+            keyValues.push_back({ir.values.at(key), key->type});
+         llvm::Value* h = ir.hash(keyValues);
+         llvm::Value* group = ir.genFind(table, h, [&](llvm::Value* r) {
+            llvm::Value* match = ir.b.getTrue();
+            for (IU* key : keys)
+               match = ir.b.CreateAnd(match, ir.compare(CmpOp::Eq, {row.load(ir, r, key), key->type}, {ir.values.at(key), key->type}));
+            return match;
+         });
+         ir.genIfElse(
+             ir.b.CreateIsNull(group),
+             [&]() {
+                llvm::Value* r = ir.call("p2cRowsInsert", ir.ptrType(), {table, h});
+                for (IU* key : keys)
+                   row.store(ir, r, key, ir.values.at(key));
+                for (auto& agg : aggs)
+                   row.store(ir, r, &agg->resultIU, agg->genInitIR(ir));
+             },
+             [&]() {
+                for (auto& agg : aggs)
+                   row.store(ir, group, &agg->resultIU, agg->genUpdateIR(ir, row.load(ir, group, &agg->resultIU)));
+             });
+      });
+
+      // output groups
+      ir.genLoop(ir.call("p2cRowsSize", ir.b.getInt64Ty(), {table}), [&](llvm::Value* i) {
+         llvm::Value* r = ir.call("p2cRowsAt", ir.ptrType(), {table, i});
+         for (IU* iu : stored)
+            if (required.contains(iu))
+               ir.values[iu] = row.load(ir, r, iu);
+         consume();
+      });
+   }
+#endif
+
    void produce(const IUSet& required, ConsumerFn consume) override {
-      // build hash table
-      print("unordered_map<tuple<{}>, tuple<{}>> {};\n", formatTypes(groupKeyIUs.v), formatTypes(resultIUs()), ht.varname);
-      input->produce(groupKeyIUs | inputIUs(), [&]() {
-         // insert tuple into hash table
-         print("auto it = {}.find({{{}}});\n", ht.varname, formatVarnames(groupKeyIUs.v));
-         genBlock(format("if (it == {}.end())", ht.varname), [&]() {
+      // pre-aggregate in thread-local hash tables
+      genState(ht.varname, [&]() { print("ParallelAggregation<tuple<{}>, tuple<{}>> {}{{pool.size(), {}}};\n", formatTypes(groupKeyIUs.v), formatTypes(resultIUs()), ht.varname, genSizeHint(*this)); });
+      input->produce(groupKeyIUs | inputIUs(), tupleAtATime(groupKeyIUs | inputIUs(), [&]() {
+         // find or insert group with a single lookup
+         print("auto [aggs, isNew] = {}.findOrInsert({{{}}});\n", ht.varname, formatVarnames(groupKeyIUs.v));
+         genBlock("if (isNew)", [&]() {
             vector<string> initValues;
             for (auto& agg : aggs)
                initValues.push_back(agg->genInitValue());
-            // insert new group
-            print("{}.insert({{{{{}}}, {{{}}}}});\n", ht.varname, formatVarnames(groupKeyIUs.v), join(initValues, ","));
+            // initialize new group
+            print("aggs = {{{}}};\n", join(initValues, ","));
          });
          genBlock("else", [&]() {
             // update group
             unsigned i = 0;
             for (auto& agg : aggs) {
-               print("{};\n", agg->genUpdate(format("get<{}>(it->second)", i++)));
+               print("{};\n", agg->genUpdate(format("get<{}>(aggs)", i++)));
             }
          });
-      });
+      }));
 
-      // iterate over hash table
-      genBlock(format("for (auto& it : {})", ht.varname), [&]() {
-         for (unsigned i = 0; i < groupKeyIUs.size(); i++) {
-            IU* iu = groupKeyIUs.v[i];
-            if (required.contains(iu))
-               provideIU(iu, format("get<{}>(it.first)", i));
-         }
+      // merge partial aggregates (partition-wise)
+      genLambda(format("{}.merge(pool, ", ht.varname), "auto& aggs, const auto& other", [&]() {
          unsigned i = 0;
          for (auto& agg : aggs) {
-            provideIU(&agg->resultIU, format("get<{}>(it.second)", i));
+            print("{};\n", agg->genMerge(format("get<{}>(aggs)", i), format("get<{}>(other)", i)));
             i++;
          }
-         consume();
       });
+      print("cardinalities.record({:#x}, {}.groupCount());\n", cardinalityId(*this), ht.varname);
+
+      // iterate over groups, one partition per morsel
+      genPipeline(format("pool.parallelFor({}.partitionCount, ", ht.varname), [&]() {
+         genBlock(format("for (uint64_t p = begin; p != end; p++) for (auto& group : {}.partition(p))", ht.varname), [&]() {
+            for (unsigned i = 0; i < groupKeyIUs.size(); i++) {
+               IU* iu = groupKeyIUs.v[i];
+               if (required.contains(iu))
+                  provideIU(iu, format("get<{}>(group.key)", i));
+            }
+            unsigned i = 0;
+            for (auto& agg : aggs) {
+               provideIU(&agg->resultIU, format("get<{}>(group.value)", i));
+               i++;
+            }
+            consumeInPipeline(consume);
+         });
+      }, ", 1);");
    }
 
    IU* getIU(const string& attName) {
@@ -518,58 +2319,550 @@ struct GroupBy : public Operator {
    }
 };
 
+// join algorithm of hash join operator
+enum class JoinStrategy {
+   Hash,   // probe one global hash table (non-partitioned)
+   Radix,  // radix-partition both inputs into cache-sized partitions first
+   Auto    // decide at runtime based on the build size
+};
+
 // hash join operator
 struct HashJoin : public Operator {
    unique_ptr<Operator> left;
    unique_ptr<Operator> right;
    // join keys from both inputs, example: left=[a, b] right=[c, d] a=c AND b=d
    vector<IU*> leftKeyIUs, rightKeyIUs;
-   // variable name for hash table
+   // join algorithm; Auto uses radix join if the build side has more than radixThreshold tuples
+   JoinStrategy strategy;
+   uint64_t radixThreshold = 1ull << 20;
+   // build a Bloom filter over the build keys and push it down into the probe-side scan
+   bool bloomFilter = false;
+   // variable names for hash table, radix join, and Bloom filter
    IU ht{"joinHT", Type::Undefined};
+   IU radix{"radixJoin", Type::Undefined};
+   IU filter{"bloomFilter", Type::Undefined};
+
+   // if set, all joins use JoinStrategy::Auto with this threshold (0: radix join for every non-empty build side)
+   static inline optional<uint64_t> forcedRadixThreshold;
 
    // constructor
-   HashJoin(unique_ptr<Operator> left, unique_ptr<Operator> right, const vector<IU*>& leftKeyIUs, const vector<IU*>& rightKeyIUs)
-       : left(std::move(left)), right(std::move(right)), leftKeyIUs(leftKeyIUs), rightKeyIUs(rightKeyIUs) {}
+   HashJoin(unique_ptr<Operator> left, unique_ptr<Operator> right, const vector<IU*>& leftKeyIUs, const vector<IU*>& rightKeyIUs, JoinStrategy strategy = JoinStrategy::Hash)
+       : left(std::move(left)), right(std::move(right)), leftKeyIUs(leftKeyIUs), rightKeyIUs(rightKeyIUs), strategy(forcedRadixThreshold ? JoinStrategy::Auto : strategy) {
+      if (forcedRadixThreshold)
+         radixThreshold = *forcedRadixThreshold;
+   }
 
    // destructor
    ~HashJoin() {}
 
    IUSet availableIUs() override { return left->availableIUs() | right->availableIUs(); }
 
+   // each key pair keeps 1/(distinct values of the side with more of them) of the cross product
+   double estimateCardinality() override {
+      double result = left->estimateCardinality() * right->estimateCardinality();
+      for (unsigned k = 0; k != leftKeyIUs.size(); k++)
+         result /= std::max(distinctValues(*left, leftKeyIUs[k]), distinctValues(*right, rightKeyIUs[k]));
+      return result;
+   }
+   optional<double> estimateDistinct(IU* iu) override { return left->availableIUs().contains(iu) ? left->estimateDistinct(iu) : right->estimateDistinct(iu); }
+
+   string fingerprint(Fingerprint& fp) override {
+      string l = left->fingerprint(fp);
+      string r = right->fingerprint(fp);
+      return format("join({},{},[{}]=[{}],{},{},{})", l, r, fp.ius(leftKeyIUs), fp.ius(rightKeyIUs), static_cast<int>(strategy), radixThreshold, bloomFilter);
+   }
+
+   // predicates that only use IUs of one input are pushed into it, the others stay above the join
+   unique_ptr<Operator> optimize(unique_ptr<Operator> self, const IUSet& required, vector<unique_ptr<Exp>> predicates) override {
+      // with statistics, the join order and build sides are chosen by estimated cost
+      if (statistics)
+         if (auto plan = orderJoins(*this, required, predicates))
+            return plan;
+      auto leftPredicates = extractPredicates(predicates, left->availableIUs());
+      auto rightPredicates = extractPredicates(predicates, right->availableIUs());
+      IUSet used = required | iusUsed(predicates);
+      left = optimizePlan(std::move(left), (used & left->availableIUs()) | IUSet(leftKeyIUs), std::move(leftPredicates));
+      right = optimizePlan(std::move(right), (used & right->availableIUs()) | IUSet(rightKeyIUs), std::move(rightPredicates));
+      return applyPredicates(std::move(self), std::move(predicates));
+   }
+
+   void interpret(Interpreter& in, const IUSet& required, const ChunkConsumer& consume) override {
+      IUSet leftRequiredIUs = (required & left->availableIUs()) | IUSet(leftKeyIUs);
+      IUSet rightRequiredIUs = (required & right->availableIUs()) | IUSet(rightKeyIUs);
+      // keys are compared in the common type of both sides
+      vector<Type> keyTypes;
+      for (unsigned k = 0; k != leftKeyIUs.size(); k++)
+         keyTypes.push_back(commonType(leftKeyIUs[k]->type, rightKeyIUs[k]->type));
+      auto hashKeys = [&](Chunk& chunk, const vector<IU*>& keyIUs, vector<Vector>& keyVectors, vector<uint64_t>& hashes) {
+         keyVectors.clear();
+         hashes.resize(chunk.count);
+         for (unsigned k = 0; k != keyIUs.size(); k++) {
+            keyVectors.push_back(cast(chunk.columns.at(keyIUs[k]), keyTypes[k], chunk.count));
+            hashValues(keyVectors.back(), chunk.count, hashes.data(), k == 0);
+         }
+      };
+
+      // build: materialize the left side
+      vector<IU*> buildIUs(leftRequiredIUs.begin(), leftRequiredIUs.end());
+      map<IU*, ColumnBuffer> buildColumns;
+      for (IU* iu : buildIUs)
+         buildColumns.emplace(iu, iu->type);
+      vector<ColumnBuffer> buildKeys(keyTypes.begin(), keyTypes.end());
+      vector<uint64_t> buildHashes, hashes;
+      vector<Vector> keyVectors;
+      left->interpret(in, leftRequiredIUs, [&](Chunk& chunk) {
+         for (IU* iu : buildIUs)
+            buildColumns.at(iu).append(chunk.columns.at(iu), chunk.count);
+         hashKeys(chunk, leftKeyIUs, keyVectors, hashes);
+         for (unsigned k = 0; k != keyVectors.size(); k++)
+            buildKeys[k].append(keyVectors[k], chunk.count);
+         buildHashes.insert(buildHashes.end(), hashes.begin(), hashes.end());
+      });
+      RowHashTable table(std::move(buildHashes));
+
+      // probe: pairs of matching rows
+      vector<uint32_t> rows;
+      vector<uint64_t> buildRows;
+      right->interpret(in, rightRequiredIUs, [&](Chunk& chunk) {
+         hashKeys(chunk, rightKeyIUs, keyVectors, hashes);
+         table.candidates(hashes.data(), chunk.count, rows, buildRows);
+         uint32_t count = rows.size();
+         for (unsigned k = 0; k != keyVectors.size(); k++)
+            count = keepEqual(keyVectors[k], buildKeys[k], rows.data(), buildRows.data(), count);
+         if (!count)
+            return;
+         Chunk out;
+         out.count = count;
+         for (IU* iu : required)
+            out.columns[iu] = rightRequiredIUs.contains(iu) ? gather(chunk.columns.at(iu), rows.data(), count) : gather(buildColumns.at(iu), buildRows.data(), count);
+         consume(out);
+      });
+   }
+
+#ifdef P2C_LLVM
+   void produceIR(IRGen& ir, const IUSet& required, ConsumerFn consume) override {
+      IUSet leftRequiredIUs = (required & left->availableIUs()) | IUSet(leftKeyIUs);
+      IUSet rightRequiredIUs = (required & right->availableIUs()) | IUSet(rightKeyIUs);
+      // keys are compared in the common type of both sides
+      auto keyValues = [&](const vector<IU*>& keyIUs) {
+         vector<IRValue> result;
+         for (unsigned k = 0; k != keyIUs.size(); k++)
+            result.push_back(ir.cast({ir.values.at(keyIUs[k]), keyIUs[k]->type}, commonType(leftKeyIUs[k]->type, rightKeyIUs[k]->type)));
+         return result;
+      };
+      IRRow row(leftRequiredIUs.v);
+      llvm::Value* table = ir.createTable(row.width);
+
+      // build: materialize the left side
+      left->produceIR(ir, leftRequiredIUs, [&]() {
+         llvm::Value* r = ir.call("p2cRowsInsert", ir.ptrType(), {table, ir.hash(keyValues(leftKeyIUs))});
+         for (IU* iu : row.ius)
+            row.store(ir, r, iu, ir.values.at(iu));
+      });
+
+      // probe: rows with the same hash and equal keys
+      right->produceIR(ir, rightRequiredIUs, [&]() {
+         vector<IRValue> probeKeys = keyValues(rightKeyIUs);
+         ir.genChain(table, ir.hash(probeKeys), [&](llvm::Value* r) {
+            for (IU* iu : row.ius)
+               ir.values[iu] = row.load(ir, r, iu);
+            vector<IRValue> buildKeys = keyValues(leftKeyIUs);
+            llvm::Value* match = ir.b.getTrue();
+            for (unsigned k = 0; k != buildKeys.size(); k++)
+               match = ir.b.CreateAnd(match, ir.compare(CmpOp::Eq, buildKeys[k], probeKeys[k]));
+            ir.genIf(match, consume);
+         });
+      });
+   }
+#endif
+
+   bool pushDownFilter(const ScanFilter& filter) override {
+      // inner join: the filter can be applied on whichever side provides the keys
+      return left->pushDownFilter(filter) || right->pushDownFilter(filter);
+   }
+
+   bool pushDownRange(const Comparison& cmp) override { return left->pushDownRange(cmp) || right->pushDownRange(cmp); }
+
    void produce(const IUSet& required, ConsumerFn consume) override {
       // figure out where required IUs come from
       IUSet leftRequiredIUs = (required & left->availableIUs()) | IUSet(leftKeyIUs);
       IUSet rightRequiredIUs = (required & right->availableIUs()) | IUSet(rightKeyIUs);
       IUSet leftPayloadIUs = leftRequiredIUs - IUSet(leftKeyIUs);  // these we need to store in hash table as payload
 
-      // build hash table
-      print("unordered_multimap<tuple<{}>, tuple<{}>> {};\n", formatTypes(leftKeyIUs), formatTypes(leftPayloadIUs.v), ht.varname);
-      left->produce(leftRequiredIUs, [&]() {
+      // build hash table (tuples are buffered per worker)
+      genState(ht.varname, [&]() { print("JoinHashTable<tuple<{}>, tuple<{}>> {}{{pool.size(), {}}};\n", formatTypes(leftKeyIUs), formatTypes(leftPayloadIUs.v), ht.varname, genSizeHint(*left)); });
+      left->produce(leftRequiredIUs, tupleAtATime(leftRequiredIUs, [&]() {
          // insert tuple into hash table
-         print("{}.insert({{{{{}}}, {{{}}}}});\n", ht.varname, formatVarnames(leftKeyIUs), formatVarnames(leftPayloadIUs.v));
-      });
+         print("{}.insert({{{}}}, {{{}}});\n", ht.varname, formatVarnames(leftKeyIUs), formatVarnames(leftPayloadIUs.v));
+      }));
+      print("cardinalities.record({:#x}, {}.bufferedSize());\n", cardinalityId(*left), ht.varname);
+
+      // sideways information passing: probe-side scan skips tuples without join partner
+      if (bloomFilter && right->pushDownFilter({rightKeyIUs, formatTypes(leftKeyIUs), filter.varname})) {
+         genState(filter.varname, [&]() { print("BloomFilter {};\n", filter.varname); });
+         print("{}.buildFilter(pool, {});\n", ht.varname, filter.varname);
+      }
+
+      switch (strategy) {
+         case JoinStrategy::Hash:
+            produceHashProbe(required, rightRequiredIUs, leftPayloadIUs, consume);
+            break;
+         case JoinStrategy::Radix:
+            produceRadixProbe(required, rightRequiredIUs, leftPayloadIUs, consume);
+            break;
+         case JoinStrategy::Auto:
+            // both variants are generated, the build size selects one at runtime
+            genBlock(format("if ({}.bufferedSize() <= {})", ht.varname, radixThreshold), [&]() {
+               produceHashProbe(required, rightRequiredIUs, leftPayloadIUs, consume);
+            });
+            genBlock("else", [&]() {
+               produceRadixProbe(required, rightRequiredIUs, leftPayloadIUs, consume);
+            });
+            break;
+      }
+   }
+
+   // unpack build-side IUs of a match (helper)
+   void provideBuildIUs(const IUSet& required, const IUSet& leftPayloadIUs, const string& entry) {
+      // unpack payload
+      unsigned countP = 0;
+      for (IU* iu : leftPayloadIUs)
+         provideIU(iu, format("get<{}>({}.payload)", countP++, entry));
+      // unpack keys if needed
+      for (unsigned i = 0; i < leftKeyIUs.size(); i++) {
+         IU* iu = leftKeyIUs[i];
+         if (required.contains(iu))
+            provideIU(iu, format("get<{}>({}.key)", i, entry));
+      }
+   }
+
+   // probe pipeline looks up each tuple in the global hash table
+   void produceHashProbe(const IUSet& required, const IUSet& rightRequiredIUs, const IUSet& leftPayloadIUs, ConsumerFn consume) {
+      // size directory from build cardinality (probing is read-only and needs no synchronization)
+      print("{}.finalize(pool);\n", ht.varname);
 
       // probe hash table
       right->produce(rightRequiredIUs, [&]() {
+         if (currentBatch) {
+            // batched probe: hash all keys and prefetch their directory slots first
+            Batch* batch = currentBatch;
+            string hashes = IU::genVar("hashes");
+            print("uint64_t {}[{}];\n", hashes, Batch::size);
+            genBlock(format("for (uint32_t k = 0; k != {}; k++)", batch->count), [&]() {
+               print("uint32_t pos = {}[k];\n", batch->sel);
+               batch->provide(IUSet(rightKeyIUs), "pos");
+               print("{}[k] = hashKey(tuple<{}>{{{}}});\n", hashes, formatTypes(leftKeyIUs), formatVarnames(rightKeyIUs));
+               print("{}.prefetch({}[k]);\n", ht.varname, hashes);
+            });
+            genBlock(format("for (uint32_t k = 0; k != {}; k++)", batch->count), [&]() {
+               print("uint32_t pos = {}[k];\n", batch->sel);
+               batch->provide(rightRequiredIUs, "pos");
+               currentBatch = nullptr;
+               genBlock(format("for ([[maybe_unused]] auto& entry : {}.equal_range({{{}}}, {}[k]))", ht.varname, formatVarnames(rightKeyIUs), hashes), [&]() {
+                  provideBuildIUs(required, leftPayloadIUs, "entry");
+                  consume();
+               });
+               currentBatch = batch;
+            });
+            return;
+         }
          // iterate over matches
-         genBlock(format("for (auto range = {}.equal_range({{{}}}); range.first!=range.second; range.first++)", ht.varname, formatVarnames(rightKeyIUs)), [&]() {
-            // unpack payload
-            unsigned countP = 0;
-            for (IU* iu : leftPayloadIUs)
-               provideIU(iu, format("get<{}>(range.first->second)", countP++));
-            // unpack keys if needed
-            for (unsigned i = 0; i < leftKeyIUs.size(); i++) {
-               IU* iu = leftKeyIUs[i];
-               if (required.contains(iu))
-                  provideIU(iu, format("get<{}>(range.first->first)", i));
-            }
+         genBlock(format("for ([[maybe_unused]] auto& entry : {}.equal_range({{{}}}))", ht.varname, formatVarnames(rightKeyIUs)), [&]() {
+            provideBuildIUs(required, leftPayloadIUs, "entry");
             // consume
             consume();
          });
       });
    }
+
+   // probe pipeline materializes its tuples, then both sides are radix partitioned and joined partition-wise
+   void produceRadixProbe(const IUSet& required, const IUSet& rightRequiredIUs, const IUSet& leftPayloadIUs, ConsumerFn consume) {
+      IUSet rightValueIUs = rightRequiredIUs - IUSet(rightKeyIUs);
+      genState(radix.varname, [&]() { print("RadixJoin<tuple<{}>, tuple<{}>, tuple<{}>> {}{{pool.size()}};\n", formatTypes(leftKeyIUs), formatTypes(leftPayloadIUs.v), formatTypes(rightValueIUs.v), radix.varname); });
+      right->produce(rightRequiredIUs, tupleAtATime(rightRequiredIUs, [&]() {
+         print("{}.insert({{{}}}, {{{}}});\n", radix.varname, formatVarnames(rightKeyIUs), formatVarnames(rightValueIUs.v));
+      }));
+
+      // join partitions
+      genLambda(format("{}.join(pool, {}, ", radix.varname, ht.varname), "[[maybe_unused]] const auto& entry, [[maybe_unused]] const auto& probe", [&]() {
+         unsigned countV = 0;
+         for (IU* iu : rightValueIUs)
+            provideIU(iu, format("get<{}>(probe.values)", countV++));
+         for (unsigned i = 0; i < rightKeyIUs.size(); i++) {
+            IU* iu = rightKeyIUs[i];
+            if (required.contains(iu))
+               provideIU(iu, format("get<{}>(probe.key)", i));
+         }
+         provideBuildIUs(required, leftPayloadIUs, "entry");
+         // consume
+         consume();
+      });
+   }
 };
 
+// query graph of a tree of hash joins: its relations are the inputs of the joins that are not joins themselves, its
+// edges are the key pairs of the joins
+//
+// Joins are enumerated with DPccp (Moerkotte and Neumann, VLDB 2006), which
+// visits every pair of a connected set of relations and a connected
+// complement once, so there are no cross products. Graphs with more than
+// maxDPRelations relations are ordered greedily, joining the pair with the
+// smallest result first. Both orientations of each join are considered, so
+// the build side is chosen along with the order. The cost of a plan is the
+// number of tuples its joins insert into hash tables (weighted, as building
+// is more expensive than probing), probe with, and produce.
+struct JoinGraph {
+   static constexpr unsigned maxDPRelations = 12;
+   static constexpr double buildWeight = 2;
+
+   struct Edge {
+      IU* ius[2];
+      unsigned relations[2];
+   };
+   // best plan for a set of relations, joining the build set with the probe set (both empty for single relations)
+   struct Plan {
+      double cardinality, cost;
+      uint64_t build = 0, probe = 0;
+   };
+
+   // where the relations are in the join tree before they are moved into the new one
+   vector<unique_ptr<Operator>*> slots;
+   vector<unique_ptr<Operator>> relations;
+   vector<Edge> edges;
+   // bit set of the neighbors of each relation
+   vector<uint64_t> neighbors;
+   unordered_map<uint64_t, Plan> plans;
+   // predicates that use more than one relation, applied by the lowest join that provides their IUs
+   vector<unique_ptr<Exp>> pending;
+   // settings of the joins of the original tree that differ from the defaults, with their key pairs
+   struct Settings {
+      vector<pair<IU*, IU*>> keys;
+      optional<pair<JoinStrategy, uint64_t>> strategy;
+      bool bloomFilter;
+   };
+   vector<Settings> settings;
+
+   // Bloom filters are only considered for probe sides of at least this many tuples (a zone map block), smaller ones
+   // are probed about as fast as the filter
+   static constexpr double minBloomProbe = 1 << 16;
+
+   // collect relations and edges of the join tree rooted at join; false if the graph is not connected
+   bool collect(HashJoin& join) {
+      vector<pair<IU*, IU*>> keys;
+      collect(join, keys);
+      if (slots.size() > 64)
+         return false;
+      neighbors.assign(slots.size(), 0);
+      for (auto [a, b] : keys) {
+         Edge edge{{a, b}, {relationOf(a), relationOf(b)}};
+         if (edge.relations[0] == edge.relations[1])
+            return false;
+         neighbors[edge.relations[0]] |= 1ull << edge.relations[1];
+         neighbors[edge.relations[1]] |= 1ull << edge.relations[0];
+         edges.push_back(edge);
+      }
+      uint64_t all = (slots.size() == 64) ? ~0ull : (1ull << slots.size()) - 1, reached = 1;
+      for (uint64_t last = 0; reached != last;) {
+         last = reached;
+         reached |= neighborhood(reached);
+      }
+      return reached == all;
+   }
+   void collect(HashJoin& join, vector<pair<IU*, IU*>>& keys) {
+      for (auto* input : {&join.left, &join.right}) {
+         if (auto child = dynamic_cast<HashJoin*>(input->get()))
+            collect(*child, keys);
+         else
+            slots.push_back(input);
+      }
+      vector<pair<IU*, IU*>> joinKeys;
+      for (unsigned k = 0; k != join.leftKeyIUs.size(); k++)
+         joinKeys.emplace_back(join.leftKeyIUs[k], join.rightKeyIUs[k]);
+      HashJoin defaults(nullptr, nullptr, {}, {});
+      bool customStrategy = join.strategy != defaults.strategy || join.radixThreshold != defaults.radixThreshold;
+      if (customStrategy || join.bloomFilter != defaults.bloomFilter)
+         settings.push_back({joinKeys, customStrategy ? optional(pair(join.strategy, join.radixThreshold)) : nullopt, join.bloomFilter});
+      keys.insert(keys.end(), joinKeys.begin(), joinKeys.end());
+   }
+
+   // settings of the original join whose key pairs are all kept by a join with keys (in any order), if it had any
+   const Settings* settingsOf(const vector<pair<IU*, IU*>>& keys) {
+      auto kept = [&](pair<IU*, IU*> key) { return ranges::count(keys, key) || ranges::count(keys, pair(key.second, key.first)); };
+      for (auto& s : settings)
+         if (ranges::all_of(s.keys, kept))
+            return &s;
+      return nullptr;
+   }
+
+   unsigned relationOf(IU* iu) {
+      unsigned r = 0;
+      while (!(*slots[r])->availableIUs().contains(iu))
+         r++;
+      return r;
+   }
+
+   // neighbors of a set of relations that are not in the set
+   uint64_t neighborhood(uint64_t set) {
+      uint64_t result = 0;
+      for (uint64_t s = set; s; s &= s - 1)
+         result |= neighbors[countr_zero(s)];
+      return result & ~set;
+   }
+
+   // estimated cardinality of joining two disjoint sets of relations
+   double joinCardinality(uint64_t s1, uint64_t s2) {
+      double result = plans.at(s1).cardinality * plans.at(s2).cardinality;
+      for (auto& edge : edges) {
+         uint64_t a = 1ull << edge.relations[0], b = 1ull << edge.relations[1];
+         if (((s1 & a) && (s2 & b)) || ((s1 & b) && (s2 & a)))
+            result /= std::max(distinctValues(*relations[edge.relations[0]], edge.ius[0]), distinctValues(*relations[edge.relations[1]], edge.ius[1]));
+      }
+      return result;
+   }
+
+   // consider joining two disjoint connected sets of relations (with either one as build side)
+   void emitPair(uint64_t s1, uint64_t s2) {
+      Plan p1 = plans.at(s1), p2 = plans.at(s2);
+      double cardinality = joinCardinality(s1, s2);
+      for (bool swap : {false, true}) {
+         Plan& build = swap ? p2 : p1;
+         Plan& probe = swap ? p1 : p2;
+         double cost = p1.cost + p2.cost + buildWeight * build.cardinality + probe.cardinality + cardinality;
+         auto [it, inserted] = plans.try_emplace(s1 | s2, Plan{cardinality, cost, swap ? s2 : s1, swap ? s1 : s2});
+         if (!inserted && cost < it->second.cost)
+            it->second = Plan{cardinality, cost, swap ? s2 : s1, swap ? s1 : s2};
+      }
+   }
+
+   // DPccp: enumerate connected subgraphs S1 in the order of the paper, each with its connected complements
+   void enumerateDP() {
+      for (unsigned i = relations.size(); i-- > 0;) {
+         uint64_t v = 1ull << i;
+         emitCsg(v);
+         enumerateCsgRec(v, (v << 1) - 1);
+      }
+   }
+   void enumerateCsgRec(uint64_t s1, uint64_t exclude) {
+      uint64_t n = neighborhood(s1) & ~exclude;
+      for (uint64_t s = n & -n; s; s = (s - n) & n)
+         emitCsg(s1 | s);
+      for (uint64_t s = n & -n; s; s = (s - n) & n)
+         enumerateCsgRec(s1 | s, exclude | n);
+   }
+   void emitCsg(uint64_t s1) {
+      // complements only contain relations after the first one of s1
+      uint64_t exclude = s1 | ((s1 & -s1) * 2 - 1);
+      uint64_t n = neighborhood(s1) & ~exclude;
+      for (unsigned i = 64; i-- > 0;) {
+         uint64_t v = 1ull << i;
+         if (!(n & v))
+            continue;
+         emitPair(s1, v);
+         enumerateCmpRec(s1, v, exclude | (n & ((v << 1) - 1)));
+      }
+   }
+   void enumerateCmpRec(uint64_t s1, uint64_t s2, uint64_t exclude) {
+      uint64_t n = neighborhood(s2) & ~exclude;
+      for (uint64_t s = n & -n; s; s = (s - n) & n)
+         emitPair(s1, s2 | s);
+      for (uint64_t s = n & -n; s; s = (s - n) & n)
+         enumerateCmpRec(s1, s2 | s, exclude | n);
+   }
+
+   // greedy operator ordering: repeatedly join the two connected sets with the smallest result
+   void enumerateGreedy() {
+      vector<uint64_t> sets;
+      for (unsigned i = 0; i != relations.size(); i++)
+         sets.push_back(1ull << i);
+      while (sets.size() > 1) {
+         optional<tuple<double, unsigned, unsigned>> best;
+         for (unsigned i = 0; i != sets.size(); i++)
+            for (unsigned j = i + 1; j != sets.size(); j++)
+               if (neighborhood(sets[i]) & sets[j]) {
+                  double cardinality = joinCardinality(sets[i], sets[j]);
+                  if (!best || cardinality < get<0>(*best))
+                     best = {cardinality, i, j};
+               }
+         auto [cardinality, i, j] = *best;
+         emitPair(sets[i], sets[j]);
+         sets[i] |= sets[j];
+         sets.erase(sets.begin() + j);
+      }
+   }
+
+   // build the best join tree for a set of relations
+   unique_ptr<Operator> build(uint64_t set) {
+      if (popcount(set) == 1)
+         return std::move(relations[countr_zero(set)]);
+      Plan plan = plans.at(set);
+      vector<IU*> buildKeys, probeKeys;
+      vector<pair<IU*, IU*>> keyPairs;
+      vector<unique_ptr<Exp>> residual;
+      for (auto& edge : edges)
+         for (unsigned side : {0, 1}) {
+            if (!((plan.build >> edge.relations[side]) & 1) || !((plan.probe >> edge.relations[1 - side]) & 1))
+               continue;
+            IU *buildKey = edge.ius[side], *probeKey = edge.ius[1 - side];
+            keyPairs.emplace_back(buildKey, probeKey);
+            // an IU is a key at most once, further equalities are checked after the join
+            if (ranges::count(buildKeys, buildKey) || ranges::count(probeKeys, probeKey)) {
+               vector<unique_ptr<Exp>> args;
+               args.push_back(make_unique<IUExp>(buildKey));
+               args.push_back(make_unique<IUExp>(probeKey));
+               residual.push_back(make_unique<FnExp>("std::equal_to()", std::move(args)));
+            } else {
+               buildKeys.push_back(buildKey);
+               probeKeys.push_back(probeKey);
+            }
+         }
+      double buildCardinality = plans.at(plan.build).cardinality, probeCardinality = plans.at(plan.probe).cardinality;
+      auto join = make_unique<HashJoin>(build(plan.build), build(plan.probe), buildKeys, probeKeys);
+      // the plan's choices are kept for the same join, the heuristics only decide what it left at the defaults
+      const Settings* original = settingsOf(keyPairs);
+      if (original && original->strategy) {
+         tie(join->strategy, join->radixThreshold) = *original->strategy;
+      } else if (buildCardinality * 4 > join->radixThreshold) {
+         // estimates are uncertain, so the runtime decides if the build side may be too large for one hash table
+         join->strategy = JoinStrategy::Auto;
+      }
+      // a Bloom filter pays off if the join removes most tuples of a large probe side
+      if (original && original->bloomFilter)
+         join->bloomFilter = true;
+      else
+         join->bloomFilter = probeCardinality >= minBloomProbe && plan.cardinality < probeCardinality / 2;
+      for (auto& exp : extractPredicates(pending, join->availableIUs()))
+         residual.push_back(std::move(exp));
+      return applyPredicates(std::move(join), std::move(residual));
+   }
+};
+
+unique_ptr<Operator> orderJoins(HashJoin& join, const IUSet& required, vector<unique_ptr<Exp>>& predicates) {
+   JoinGraph graph;
+   if (!graph.collect(join))
+      return nullptr;
+   // predicates on one relation are pushed into it
+   vector<vector<unique_ptr<Exp>>> relationPredicates;
+   for (auto* slot : graph.slots)
+      relationPredicates.push_back(extractPredicates(predicates, (*slot)->availableIUs()));
+   graph.pending = std::move(predicates);
+   predicates.clear();
+   IUSet used = required | iusUsed(graph.pending);
+   for (auto& edge : graph.edges)
+      for (IU* iu : edge.ius)
+         used.add(iu);
+   for (unsigned r = 0; r != graph.slots.size(); r++) {
+      IUSet available = (*graph.slots[r])->availableIUs();
+      graph.relations.push_back(optimizePlan(std::move(*graph.slots[r]), used & available, std::move(relationPredicates[r])));
+      graph.plans[1ull << r] = {graph.relations.back()->estimateCardinality(), 0};
+   }
+   if (graph.relations.size() <= JoinGraph::maxDPRelations)
+      graph.enumerateDP();
+   else
+      graph.enumerateGreedy();
+   uint64_t all = graph.relations.size() == 64 ? ~0ull : (1ull << graph.relations.size()) - 1;
+   return graph.build(all);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 // create a function call expression (helper)
@@ -589,20 +2882,450 @@ unique_ptr<Exp> makeCallExp(const string& fn, std::unique_ptr<T>... args) {
    return make_unique<FnExp>(fn, std::move(v));
 }
 
-// Print
-void produceAndPrint(unique_ptr<Operator> root, const std::vector<IU*>& ius, unsigned perfRepeat = 2) {
+// parameters of all queries; values can be changed with --param <index>=<value>
+QueryParams queryParams;
+vector<pair<unsigned, string>> paramArgs;
+
+// add a query parameter with its default value and return an expression reading it
+template<typename T>
+unique_ptr<Exp> makeParamExp(const T& value) {
+   return make_unique<ParamExp<T>>(queryParams.add(value));
+}
+
+// generate code that declares the argument block with the current parameter values (helper)
+void genParams() {
+   print("QueryParams params;\n");
+   for (unsigned i = 0; i != queryParams.size(); i++)
+      visit([](const auto& value) {
+         using T = decay_t<decltype(value)>;
+         if constexpr (is_same_v<T, string>)
+            print("params.add<std::string_view>(\"{}\");\n", value);
+         else if constexpr (is_same_v<T, date>)
+            print("params.add<date>(date({}));\n", value.value);
+         else
+            print("params.add<{}>({});\n", tname(type_tag<T>::tag), ConstExp<T>(value).compile());
+      }, queryParams[i]);
+}
+
+// generate code that runs the query once and prints its result
+void genResult(Operator& root, const std::vector<IU*>& ius) {
+   // result tuples may be produced by multiple workers concurrently
+   string printMutex = IU::genVar("printMutex");
+   genState(printMutex, [&]() { print("mutex {};\n", printMutex); });
+   root.produce(IUSet(ius), tupleAtATime(IUSet(ius), [&]() {
+      print("lock_guard lock({});\n", printMutex);
+      for (IU* iu : ius)
+         print("cout << {} << \" \";", iu->varname);
+      print("cout << endl;\n");
+   }));
+}
+
+// generate code that prints the query result
+void genPrint(Operator& root, const std::vector<IU*>& ius, unsigned perfRepeat) {
    genBlock(format("for (uint64_t {0} = 0; {0} != {1}; {0}++)", IU::genVar("perfRepeat"), perfRepeat - 1), [&]() {
-      root->produce(IUSet(ius), [&]() {
-         for (IU* iu : ius)
-            print("cout << {} << \" \";", iu->varname);
-         print("cout << endl;\n");
-      });
+      genResult(root, ius);
    });
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// library mode (--run): queries are compiled into shared objects and run in this process
+struct LibraryMode {
+   string dataDir;
+   unsigned runCount = 1;
+   unsigned threads = thread::hardware_concurrency();
+   // compiled queries, disabled by --no-cache
+   optional<QueryCache> cache;
+   // --tiered: start with the baseline build and switch to the optimized build when it is compiled
+   bool tiered = false;
+   CompileOptions baseline;
+   CompileOptions optimized = {.optimization = "-O3"};
+   // --interpret: run queries with the vectorized interpreter instead of compiling them
+   bool interpret = false;
+   // --llvm: generate LLVM IR instead of C++ and compile it with the JIT
+   bool llvm = false;
+   // in a long-running process, the database is mapped once for all queries
+   optional<TPCH> db;
+   optional<ThreadPool> pool;
+   optional<ColumnStore> columns;
+};
+optional<LibraryMode> libraryMode;
+
+// run query with the interpreter (single-threaded, no C++ compiler involved)
+void interpretInProcess(Operator& root, const std::vector<IU*>& ius, unsigned perfRepeat) {
+   using clock = chrono::steady_clock;
+   auto& mode = *libraryMode;
+   auto start = clock::now();
+   if (!mode.columns)
+      mode.columns.emplace(mode.dataDir);
+   auto ready = clock::now();
+   Interpreter in{*mode.columns, queryParams};
+   for (unsigned run = 0; run < mode.runCount; ++run)
+      for (unsigned repeat = 0; repeat + 1 < perfRepeat; repeat++)
+         root.interpret(in, IUSet(ius), [&](Chunk& chunk) {
+            for (uint32_t i = 0; i != chunk.count; i++) {
+               for (IU* iu : ius) {
+                  printValue(cout, chunk.columns.at(iu), i);
+                  cout << " ";
+               }
+               cout << endl;
+            }
+         });
+   auto done = clock::now();
+   auto ms = [](auto d) { return chrono::duration<double, milli>(d).count(); };
+   cerr << format("interpret: open database: {:.1f} ms, run: {:.1f} ms\n", ms(ready - start), ms(done - ready));
+}
+
+#ifdef P2C_LLVM
+// generate LLVM IR for the query, compile it with the JIT, and run it in this process (single-threaded)
+void jitInProcess(Operator& root, const std::vector<IU*>& ius, unsigned perfRepeat) {
+   using clock = chrono::steady_clock;
+   auto ms = [](auto d) { return chrono::duration<double, milli>(d).count(); };
+   auto& mode = *libraryMode;
+   auto start = clock::now();
+   Jit jit;
+   IRGen ir(jit.dataLayout());
+   root.produceIR(ir, IUSet(ius), [&]() {
+      for (IU* iu : ius)
+         ir.print(iu);
+      ir.call("p2cPrintEnd", ir.b.getVoidTy(), {});
+   });
+   ir.finish();
+   auto generated = clock::now();
+   auto query = reinterpret_cast<void (*)(const void* const*, const uint64_t*, const QueryParams*)>(jit.compile(std::move(ir.module), std::move(ir.context), "query"));
+   auto compiled = clock::now();
+
+   if (!mode.columns)
+      mode.columns.emplace(mode.dataDir);
+   vector<const void*> columns;
+   vector<uint64_t> counts;
+   for (auto& [relation, name, type] : ir.columns)
+      columns.push_back(mode.columns->data(relation, name, type));
+   for (auto& [relation, name, type] : ir.counts)
+      counts.push_back(mode.columns->tupleCount(relation, name, type));
+   auto ready = clock::now();
+   for (unsigned run = 0; run < mode.runCount; ++run)
+      for (unsigned repeat = 0; repeat + 1 < perfRepeat; repeat++)
+         query(columns.data(), counts.data(), &queryParams);
+   auto done = clock::now();
+   cerr << format("llvm: codegen: {:.1f} ms, jit: {:.1f} ms, open database: {:.1f} ms, run: {:.1f} ms\n", ms(generated - start), ms(compiled - generated), ms(ready - compiled), ms(done - ready));
+}
+#endif
+
+// compile query (unless cached) and run it in this process
+void runInProcess(Operator& root, const std::vector<IU*>& ius, unsigned perfRepeat) {
+   using clock = chrono::steady_clock;
+   auto ms = [](auto d) { return chrono::duration<double, milli>(d).count(); };
+   auto& mode = *libraryMode;
+   auto start = clock::now();
+   tieredPipelines = mode.tiered;
+   tieredPipelineCount = 0;
+   Fingerprint fp;
+   string rootPlan = root.fingerprint(fp);
+   string plan = format("print({},[{}],{}){}", rootPlan, fp.ius(ius), perfRepeat, mode.tiered ? ",tiered" : "");
+   // hash table sizes of earlier runs of the plan on this database, used by generated code to size its hash tables
+   filesystem::path feedbackFile = QueryCache::defaultDir() / format("{:016x}.feedback", fnv1a(rootPlan + "\n" + mode.dataDir));
+   cardinalities = Cardinalities::read(feedbackFile);
+
+   TempDir dir;
+   vector<filesystem::path> sources;
+   auto lookup = [&](const CompileOptions& options) -> optional<filesystem::path> {
+      if (!mode.cache)
+         return nullopt;
+      return mode.cache->lookup(mode.cache->key(plan, options));
+   };
+   auto generate = [&]() {
+      if (!sources.empty())
+         return;
+      // write generated code into source files (state.hpp, query.cpp, and one per pipeline) instead of stdout
+      splitUnits = SplitUnits{dir.path};
+      {
+         StdoutRedirect redirect(dir.path / "state.hpp");
+         cout << stateHeaderPrologue();
+      }
+      {
+         StdoutRedirect redirect(dir.path / "query.cpp");
+         cout << queryPrologue();
+         genResult(root, ius);
+         cout << queryEpilogue(perfRepeat);
+      }
+      {
+         StdoutRedirect redirect(dir.path / "state.hpp", true);
+         cout << stateHeaderEpilogue(splitUnits->pipelineCount);
+      }
+      sources.push_back(dir.path / "query.cpp");
+      for (unsigned i = 0; i != splitUnits->pipelineCount; i++)
+         sources.push_back(dir.path / format("pipeline{}.cpp", i));
+      splitUnits.reset();
+   };
+   // set to kill the compiler processes of the optimized build in tiered mode
+   atomic<bool> cancelBuild{false};
+   auto build = [&](const CompileOptions& options) {
+      generate();
+      // the precompiled header is cached with the queries (if the cache is enabled)
+      filesystem::path pchDir = mode.cache ? mode.cache->headerDir(options) : dir.path / format("pch{}", options.optimization);
+      auto compile = [&](const filesystem::path& so) { compileUnits(sources, so, options, pchDir, &cancelBuild); };
+      if (mode.cache)
+         return mode.cache->insert(mode.cache->key(plan, options), compile);
+      filesystem::path so = dir.path / format("query{}.so", options.optimization);
+      compile(so);
+      return so;
+   };
+
+   // in tiered mode, a cached optimized build is used right away
+   optional<filesystem::path> optimizedSo = mode.tiered ? lookup(mode.optimized) : nullopt;
+   optional<filesystem::path> so = optimizedSo ? optimizedSo : lookup(mode.baseline);
+   bool cached = so.has_value();
+   if (!so)
+      so = build(mode.baseline);
+   auto compiled = clock::now();
+   CompiledQuery query(so->string());
+   auto loaded = clock::now();
+
+   Tiering tiering;
+   optional<CompiledQuery> optimizedQuery;
+   optional<clock::time_point> optimizedReady;
+   thread background;
+   if (optimizedSo) {
+      tiering.switchTo(query.tierTable());
+   } else if (mode.tiered) {
+      // source is generated before the thread starts, as generating code is not thread-safe
+      generate();
+      background = thread([&]() {
+         try {
+            optimizedQuery.emplace(build(mode.optimized).string());
+            tiering.switchTo(optimizedQuery->tierTable());
+            optimizedReady = clock::now();
+         } catch (const BuildCancelled&) {
+         } catch (const exception& e) {
+            cerr << "optimized build failed: " << e.what() << endl;
+         }
+      });
+   }
+
+   if (!mode.db) {
+      mode.db.emplace(mode.dataDir);
+      mode.pool.emplace(mode.threads);
+   }
+   auto ready = clock::now();
+   for (unsigned run = 0; run < mode.runCount; ++run)
+      query(*mode.db, *mode.pool, queryParams, tiering, cardinalities);
+   auto done = clock::now();
+   filesystem::create_directories(feedbackFile.parent_path());
+   cardinalities.write(feedbackFile);
+   cerr << format("{}: {:.1f} ms, load: {:.1f} ms, open database: {:.1f} ms, run: {:.1f} ms\n", cached ? "cache hit" : "compile", ms(compiled - start), ms(loaded - compiled), ms(ready - loaded), ms(done - ready));
+   if (mode.tiered) {
+      cerr << format("tiers: {} tuples {}, {} tuples {}\n", tiering.tupleCount(Tiering::Unoptimized), mode.baseline.optimization, tiering.tupleCount(Tiering::Optimized), mode.optimized.optimization);
+      if (background.joinable()) {
+         // the query is done: an unfinished optimized build is only worth finishing if it is cached for the next run
+         if (!mode.cache)
+            cancelBuild = true;
+         background.join();
+         if (optimizedReady)
+            cerr << format("optimized build: {} after {:.1f} ms (after the query: {:.1f} ms)\n", mode.cache ? "cached" : "ready", ms(*optimizedReady - start), max(0.0, ms(*optimizedReady - done)));
+         else if (cancelBuild)
+            cerr << "optimized build: cancelled\n";
+      }
+   }
+}
+
+unique_ptr<Operator> optimizePlan(unique_ptr<Operator> op, const IUSet& required, vector<unique_ptr<Exp>> predicates) {
+   Operator* root = op.get();
+   return root->optimize(std::move(op), required, std::move(predicates));
+}
+
+// rewrite plans before generating code for them (disabled by --no-optimize)
+bool optimizePlans = true;
+
+// print code of the query, or run it in library mode
+void produceAndPrint(unique_ptr<Operator> root, const std::vector<IU*>& ius, unsigned perfRepeat = 2) {
+   for (auto& [index, value] : paramArgs) {
+      if (index >= queryParams.size()) {
+         cerr << "invalid parameter index " << index << ": the query has " << queryParams.size() << " parameters" << endl;
+         exit(1);
+      }
+      try {
+         queryParams.parse(index, value);
+      } catch (const invalid_argument& e) {
+         cerr << e.what() << " (parameter " << index << ")" << endl;
+         exit(1);
+      }
+   }
+   if (optimizePlans)
+      root = optimizePlan(std::move(root), IUSet(ius));
+   if (libraryMode) {
+      if (libraryMode->interpret)
+         interpretInProcess(*root, ius, perfRepeat);
+#ifdef P2C_LLVM
+      else if (libraryMode->llvm)
+         jitInProcess(*root, ius, perfRepeat);
+#endif
+      else
+         runInProcess(*root, ius, perfRepeat);
+      return;
+   }
+   genBlock("", [&]() {
+      genParams();
+      print("Cardinalities cardinalities;\n");
+      genPrint(*root, ius, perfRepeat);
+   });
+}
+
+// small plans that cover the operators Q5 does not use (run with --plan <name>, compared across backends by check.sh)
+bool produceTestPlan(string_view name) {
+   if (name == "groupby") {
+      // Q1-like: select l_returnflag, l_linestatus, sum(l_quantity), sum(l_extendedprice), min(l_discount), count(*)
+      // from lineitem where l_shipdate <= date '1998-09-02' group by l_returnflag, l_linestatus order by l_returnflag, l_linestatus
+      auto l = make_unique<Scan>("lineitem");
+      IU* l_returnflag = l->getIU("l_returnflag");
+      IU* l_linestatus = l->getIU("l_linestatus");
+      IU* l_quantity = l->getIU("l_quantity");
+      IU* l_extendedprice = l->getIU("l_extendedprice");
+      IU* l_discount = l->getIU("l_discount");
+      IU* l_shipdate = l->getIU("l_shipdate");
+      auto sel = make_unique<Selection>(std::move(l), makeCallExp("std::less_equal()", make_unique<IUExp>(l_shipdate), makeParamExp(stringToType<date>("1998-09-02", 10))));
+      auto gb = make_unique<GroupBy>(std::move(sel), IUSet({l_returnflag, l_linestatus}));
+      gb->addAggregate(make_unique<SumAggregate>("sum_qty", l_quantity));
+      gb->addAggregate(make_unique<SumAggregate>("sum_price", l_extendedprice));
+      gb->addAggregate(make_unique<MinAggregate>("min_disc", l_discount));
+      gb->addAggregate(make_unique<CountAggregate>("count_order"));
+      vector<IU*> ius{l_returnflag, l_linestatus, gb->getIU("sum_qty"), gb->getIU("sum_price"), gb->getIU("min_disc"), gb->getIU("count_order")};
+      auto sort = make_unique<Sort>(std::move(gb), vector<IU*>{l_returnflag, l_linestatus}, vector<bool>{true, true});
+      produceAndPrint(std::move(sort), ius);
+   } else if (name == "sort") {
+      // select o_orderkey, o_orderdate, o_totalprice from orders where o_orderdate < date '1992-03-01' order by o_orderdate, o_orderkey desc
+      auto o = make_unique<Scan>("orders");
+      IU* o_orderkey = o->getIU("o_orderkey");
+      IU* o_orderdate = o->getIU("o_orderdate");
+      IU* o_totalprice = o->getIU("o_totalprice");
+      auto sel = make_unique<Selection>(std::move(o), makeCallExp("std::less()", make_unique<IUExp>(o_orderdate), makeParamExp(stringToType<date>("1992-03-01", 10))));
+      auto sort = make_unique<Sort>(std::move(sel), vector<IU*>{o_orderdate, o_orderkey}, vector<bool>{true, false});
+      produceAndPrint(std::move(sort), {o_orderkey, o_orderdate, o_totalprice});
+   } else if (name == "sortstring") {
+      // select c_custkey, c_name, c_acctbal from customer order by c_nationkey, c_name desc, c_acctbal
+      // (names share their first 16 bytes, the prefix in the normalized key, with up to 99 others)
+      auto c = make_unique<Scan>("customer");
+      IU* c_custkey = c->getIU("c_custkey");
+      IU* c_name = c->getIU("c_name");
+      IU* c_nationkey = c->getIU("c_nationkey");
+      IU* c_acctbal = c->getIU("c_acctbal");
+      auto sort = make_unique<Sort>(std::move(c), vector<IU*>{c_nationkey, c_name, c_acctbal}, vector<bool>{true, false, true});
+      produceAndPrint(std::move(sort), {c_custkey, c_name, c_acctbal});
+   } else if (name == "topk") {
+      // select l_orderkey, l_linenumber, l_extendedprice from lineitem order by l_extendedprice desc, l_orderkey, l_linenumber limit 10
+      auto l = make_unique<Scan>("lineitem");
+      IU* l_orderkey = l->getIU("l_orderkey");
+      IU* l_linenumber = l->getIU("l_linenumber");
+      IU* l_extendedprice = l->getIU("l_extendedprice");
+      auto topk = make_unique<TopK>(std::move(l), vector<IU*>{l_extendedprice, l_orderkey, l_linenumber}, vector<bool>{false, true, true}, 10);
+      produceAndPrint(std::move(topk), {l_orderkey, l_linenumber, l_extendedprice});
+   } else if (name == "limit") {
+      // select n_name, count(*) from customer, nation where c_nationkey = n_nationkey group by n_name order by count(*) desc, n_name limit 5
+      auto n = make_unique<Scan>("nation");
+      IU* n_nationkey = n->getIU("n_nationkey");
+      IU* n_name = n->getIU("n_name");
+      auto c = make_unique<Scan>("customer");
+      IU* c_nationkey = c->getIU("c_nationkey");
+      auto join = make_unique<HashJoin>(std::move(n), std::move(c), vector<IU*>{n_nationkey}, vector<IU*>{c_nationkey});
+      auto gb = make_unique<GroupBy>(std::move(join), IUSet({n_name}));
+      gb->addAggregate(make_unique<CountAggregate>("customers"));
+      IU* customers = gb->getIU("customers");
+      auto sort = make_unique<Sort>(std::move(gb), vector<IU*>{customers, n_name}, vector<bool>{false, true});
+      auto limit = make_unique<Limit>(std::move(sort), 5);
+      produceAndPrint(std::move(limit), {n_name, customers});
+   } else {
+      return false;
+   }
+   return true;
+}
+
 int main(int argc, char* argv[]) {
+   // --vectorized: generate scan pipelines batch-at-a-time instead of tuple-at-a-time
+   // --run <data dir> [runs] [threads]: compile and run the query in this process instead of printing its code
+   // --no-cache: always generate and compile in library mode (instead of reusing compiled queries with the same plan)
+   // --param <index>=<value>: set query parameter
+   // --tiered: in library mode, start running a quickly compiled build and switch to an optimized build once it is compiled
+   // --interpret: in library mode, run the query with the vectorized interpreter instead of compiling it
+   // --llvm: in library mode, generate LLVM IR and compile it with the JIT instead of a C++ compiler (if p2c is built with LLVM)
+   // --no-optimize: generate code for the plan as it is written (no predicate push down, constant folding, removal of unused maps, or join ordering)
+   // --plan <name>: run a test plan (see produceTestPlan) instead of Q5
+   // --radix-threshold <n>: all joins choose at runtime between hash and radix join with this build size threshold
+   bool useCache = true, tiered = false, interpret = false, llvm = false;
+   string_view planName = "q5";
+   for (int i = 1; i < argc; i++) {
+      if (string_view(argv[i]) == "--vectorized")
+         Scan::defaultVectorized = true;
+      if (string_view(argv[i]) == "--no-cache")
+         useCache = false;
+      if (string_view(argv[i]) == "--tiered")
+         tiered = true;
+      if (string_view(argv[i]) == "--interpret")
+         interpret = true;
+      if (string_view(argv[i]) == "--llvm")
+         llvm = true;
+      if (string_view(argv[i]) == "--no-optimize")
+         optimizePlans = false;
+      if (string_view(argv[i]) == "--plan" && i + 1 < argc)
+         planName = argv[++i];
+      if (string_view(argv[i]) == "--radix-threshold" && i + 1 < argc) {
+         string_view arg = argv[++i];
+         uint64_t threshold;
+         auto [end, ec] = from_chars(arg.data(), arg.data() + arg.size(), threshold);
+         if (ec != errc() || end != arg.data() + arg.size()) {
+            cerr << "invalid radix threshold: " << arg << endl;
+            return 1;
+         }
+         HashJoin::forcedRadixThreshold = threshold;
+      }
+      if (string_view(argv[i]) == "--param" && i + 1 < argc) {
+         string_view arg = argv[++i];
+         auto eq = arg.find('=');
+         unsigned index;
+         // the index must be a decimal number that ends at '='
+         auto [end, ec] = from_chars(arg.data(), arg.data() + min(eq, arg.size()), index);
+         if (eq == string_view::npos || eq == 0 || ec != errc() || end != arg.data() + eq) {
+            cerr << "invalid parameter: " << arg << " (expected <index>=<value>)" << endl;
+            return 1;
+         }
+         paramArgs.emplace_back(index, string(arg.substr(eq + 1)));
+      }
+      if (string_view(argv[i]) == "--run" && i + 1 < argc) {
+         libraryMode.emplace();
+         libraryMode->dataDir = argv[++i];
+         if (i + 1 < argc && isdigit(argv[i + 1][0]))
+            libraryMode->runCount = atoi(argv[++i]);
+         if (i + 1 < argc && isdigit(argv[i + 1][0]))
+            libraryMode->threads = atoi(argv[++i]);
+      }
+   }
+#ifndef P2C_LLVM
+   if (llvm) {
+      cerr << "p2c was built without LLVM (see Makefile)" << endl;
+      return 1;
+   }
+#endif
+   // joins are ordered by the statistics of the database the query runs on (queryFrame.cpp's default in print mode)
+   string statisticsDir = libraryMode ? libraryMode->dataDir : "data-generator/output/";
+   if (filesystem::exists(filesystem::path(statisticsDir) / "region"))
+      statistics.emplace(statisticsDir);
+   if (libraryMode && useCache && !interpret && !llvm)
+      libraryMode->cache.emplace();
+   if (libraryMode) {
+      libraryMode->tiered = tiered;
+      libraryMode->interpret = interpret;
+      libraryMode->llvm = llvm;
+   }
+
+   if (planName != "q5") {
+      bool known = produceTestPlan(planName);
+      libraryMode.reset();
+      if (!known) {
+         cerr << "unknown plan: " << planName << endl;
+         return 1;
+      }
+      return 0;
+   }
+
    // ------------------------------------------------------------
    // TPC-H Query 5; should return the following on sf1 according to umbra:
    // INDONESIA 55502041.1697
@@ -640,9 +3363,8 @@ int main(int argc, char* argv[]) {
       auto r = make_unique<Scan>("region");
       IU* r_regionkey = r->getIU("r_regionkey");
       IU* r_name = r->getIU("r_name");
-      auto r_sel =
-          make_unique<Selection>(std::move(r), makeCallExp("std::equal_to()", make_unique<IUExp>(r_name),
-                                                           make_unique<ConstExp<string_view>>("ASIA")));
+      // parameters: 0 = region, 1 = first order date, 2 = end of the order date range
+      auto r_sel = make_unique<Selection>(std::move(r), makeCallExp("std::equal_to()", make_unique<IUExp>(r_name), makeParamExp<string_view>("ASIA")));
 
       auto n = make_unique<Scan>("nation");
       IU* n_nationkey = n->getIU("n_nationkey");
@@ -659,8 +3381,8 @@ int main(int argc, char* argv[]) {
       auto o_orderkey = o->getIU("o_orderkey");
       auto o_custkey = o->getIU("o_custkey");
       auto o_orderdate = o->getIU("o_orderdate");
-      auto lowerBoundExp = makeCallExp("std::greater_equal()", o_orderdate, stringToType<date>("1994-01-01", 10).value);
-      auto upperBoundExp = makeCallExp("std::less()", o_orderdate, stringToType<date>("1995-01-01", 10).value);
+      auto lowerBoundExp = makeCallExp("std::greater_equal()", make_unique<IUExp>(o_orderdate), makeParamExp(stringToType<date>("1994-01-01", 10)));
+      auto upperBoundExp = makeCallExp("std::less()", make_unique<IUExp>(o_orderdate), makeParamExp(stringToType<date>("1995-01-01", 10)));
       auto o_sel = make_unique<Selection>(std::move(o), makeCallExp("std::logical_and()", std::move(lowerBoundExp), std::move(upperBoundExp)));
       auto join3 = make_unique<HashJoin>(std::move(join2), std::move(o_sel), vector<IU*>{c_custkey}, vector<IU*>{o_custkey});
 
@@ -669,7 +3391,8 @@ int main(int argc, char* argv[]) {
       auto l_suppkey = l->getIU("l_suppkey");
       auto l_extendedprice = l->getIU("l_extendedprice");
       auto l_discount = l->getIU("l_discount");
-      auto join4 = make_unique<HashJoin>(std::move(join3), std::move(l), vector<IU*>{o_orderkey}, vector<IU*>{l_orderkey});
+      auto join4 = make_unique<HashJoin>(std::move(join3), std::move(l), vector<IU*>{o_orderkey}, vector<IU*>{l_orderkey}, JoinStrategy::Auto);
+      join4->bloomFilter = true;
 
       auto s = make_unique<Scan>("supplier");
       auto s_suppkey = s->getIU("s_suppkey");
@@ -687,5 +3410,7 @@ int main(int argc, char* argv[]) {
       auto sort = make_unique<Sort>(std::move(gb), vector<IU*>{revenue}, vector<bool>{false});
       produceAndPrint(std::move(sort), {n_name, revenue});
    }
+
+   libraryMode.reset();
    return 0;
 }
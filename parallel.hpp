@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace p2c {
+
+// id of the worker executing the current morsel (the main thread is worker 0)
+inline thread_local unsigned workerId = 0;
+
+// value on its own cache line, avoids false sharing between workers
+template<typename T>
+struct alignas(64) Padded {
+   T value;
+};
+
+// one instance of T per worker, used for thread-local state of pipeline breakers
+template<typename T>
+struct PerWorker {
+   std::vector<Padded<T>> slots;
+
+   struct iterator {
+      Padded<T>* ptr;
+      T& operator*() const { return ptr->value; }
+      iterator& operator++() {
+         ++ptr;
+         return *this;
+      }
+      bool operator!=(const iterator& rhs) const { return ptr != rhs.ptr; }
+   };
+
+   explicit PerWorker(unsigned workerCount) : slots(workerCount) {}
+
+   // instance of the calling worker
+   T& local() { return slots[workerId].value; }
+
+   T& operator[](unsigned idx) { return slots[idx].value; }
+   unsigned size() const { return slots.size(); }
+   iterator begin() { return {slots.data()}; }
+   iterator end() { return {slots.data() + slots.size()}; }
+};
+
+// thread pool executing morsel-driven parallel loops
+//
+// A parallel loop splits [0, n) into one contiguous range per worker. Workers
+// take morsels from the front of their own range first and then steal
+// morsels from the ranges of the other workers until all ranges are drained.
+class ThreadPool {
+   struct alignas(64) Range {
+      std::atomic<uint64_t> next;
+      uint64_t end;
+   };
+
+   unsigned workerCount;
+   std::unique_ptr<Range[]> ranges;
+   std::vector<std::thread> threads;
+
+   std::mutex mutex;
+   std::condition_variable wakeup, finished;
+   std::function<void(uint64_t, uint64_t)> job;
+   uint64_t morselSize = 0;
+   std::atomic<bool> stopped = false;
+   uint64_t generation = 0;
+   unsigned busy = 0;
+   bool shutdown = false;
+
+   // process morsels of own range, then steal from the others
+   void work(unsigned id) {
+      for (unsigned k = 0; k != workerCount; k++) {
+         Range& r = ranges[(id + k) % workerCount];
+         while (!stopped.load(std::memory_order_relaxed)) {
+            uint64_t begin = r.next.fetch_add(morselSize, std::memory_order_relaxed);
+            if (begin >= r.end)
+               break;
+            job(begin, std::min(begin + morselSize, r.end));
+         }
+      }
+   }
+
+   void workerLoop(unsigned id) {
+      workerId = id;
+      uint64_t seen = 0;
+      while (true) {
+         {
+            std::unique_lock lock(mutex);
+            wakeup.wait(lock, [&]() { return shutdown || generation != seen; });
+            if (shutdown)
+               return;
+            seen = generation;
+         }
+         work(id);
+         std::unique_lock lock(mutex);
+         if (--busy == 0)
+            finished.notify_one();
+      }
+   }
+
+public:
+   explicit ThreadPool(unsigned workerCount = std::thread::hardware_concurrency())
+       : workerCount(std::max(workerCount, 1u)), ranges(new Range[this->workerCount]) {
+      for (unsigned id = 1; id != this->workerCount; id++)
+         threads.emplace_back([this, id]() { workerLoop(id); });
+   }
+
+   ~ThreadPool() {
+      {
+         std::unique_lock lock(mutex);
+         shutdown = true;
+      }
+      wakeup.notify_all();
+      for (auto& t : threads)
+         t.join();
+   }
+
+   ThreadPool(const ThreadPool&) = delete;
+
+   unsigned size() const { return workerCount; }
+
+   // stop handing out morsels of the running parallel loop (e.g., when a limit is reached)
+   void stop() { stopped.store(true, std::memory_order_relaxed); }
+
+   // call fn(begin, end) for morsels covering [0, n); returns when all morsels are done or the loop was stopped
+   template<typename Fn>
+   void parallelFor(uint64_t n, Fn&& fn, uint64_t morselSize = 16384) {
+      stopped.store(false, std::memory_order_relaxed);
+      if (workerCount == 1 || n <= morselSize) {
+         // not worth waking up the other workers
+         if (n)
+            fn(0, n);
+         return;
+      }
+      uint64_t perWorker = (n + workerCount - 1) / workerCount;
+      for (unsigned id = 0; id != workerCount; id++) {
+         ranges[id].next.store(std::min(id * perWorker, n), std::memory_order_relaxed);
+         ranges[id].end = std::min((id + 1) * perWorker, n);
+      }
+      {
+         std::unique_lock lock(mutex);
+         job = std::ref(fn);
+         this->morselSize = morselSize;
+         busy = workerCount - 1;
+         generation++;
+      }
+      wakeup.notify_all();
+      work(0);
+      std::unique_lock lock(mutex);
+      finished.wait(lock, [&]() { return busy == 0; });
+      job = nullptr;
+   }
+};
+
+}  // namespace p2c
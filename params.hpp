@@ -0,0 +1,83 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "types.hpp"
+
+namespace p2c {
+
+// argument block of a compiled query: values of the query parameters, which
+// the generated code reads at runtime (so one compiled query serves all values)
+class QueryParams {
+public:
+   // strings are owned by the argument block
+   using Value = std::variant<int32_t, double, char, std::string, int64_t, date>;
+
+private:
+   std::vector<Value> values;
+
+   template<typename T>
+   using Stored = std::conditional_t<std::is_same_v<T, std::string_view>, std::string, T>;
+
+   template<typename T>
+   static T parseNumber(std::string_view text) {
+      T value;
+      auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+      if (ec != std::errc() || end != text.data() + text.size())
+         throw std::invalid_argument("invalid parameter value: " + std::string(text));
+      return value;
+   }
+
+   static date parseDate(std::string_view text) {
+      // stringToType<date> throws a C string on malformed input
+      try {
+         return stringToType<date>(text.data(), text.size());
+      } catch (const char*) {
+         throw std::invalid_argument("invalid parameter value: " + std::string(text));
+      }
+   }
+
+public:
+   // append parameter, returns its index
+   template<typename T>
+   unsigned add(const T& value) {
+      values.emplace_back(std::in_place_type<Stored<T>>, value);
+      return values.size() - 1;
+   }
+
+   // value of parameter i (T must be the type it was added with)
+   template<typename T>
+   T get(unsigned i) const {
+      return std::get<Stored<T>>(values[i]);
+   }
+
+   // replace the value of parameter i by text parsed as the parameter's type (std::out_of_range if there is no parameter
+   // i, std::invalid_argument if text is not a value of its type)
+   void parse(unsigned i, std::string_view text) {
+      std::visit(
+          [&](auto& value) {
+             using T = std::decay_t<decltype(value)>;
+             if constexpr (std::is_same_v<T, std::string>)
+                value = text;
+             else if constexpr (std::is_same_v<T, char>)
+                value = text.size() == 1 ? text[0] : throw std::invalid_argument("invalid parameter value: " + std::string(text));
+             else if constexpr (std::is_same_v<T, date>)
+                value = parseDate(text);
+             else
+                value = parseNumber<T>(text);
+          },
+          values.at(i));
+   }
+
+   const Value& operator[](unsigned i) const { return values[i]; }
+   unsigned size() const { return values.size(); }
+};
+
+}  // namespace p2c
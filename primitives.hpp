@@ -0,0 +1,549 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "hashtable.hpp"
+#include "simd.hpp"
+#include "tpch.hpp"
+#include "types.hpp"
+
+namespace p2c {
+
+////////////////////////////////////////////////////////////////////////////////
+// Vectorized primitives of the interpreter: plans are run without compiling
+// them by calling these primitives on chunks of rows. Every primitive is a
+// template over the value type that is instantiated for all types of the
+// Type enum; dispatchType selects the instance at runtime, once per chunk.
+
+// call fn with std::type_identity of the C++ type of t
+template<typename Fn>
+decltype(auto) dispatchType(Type t, Fn&& fn) {
+   switch (t) {
+      case Type::Integer: return fn(std::type_identity<int32_t>{});
+      case Type::Double: return fn(std::type_identity<double>{});
+      case Type::Char: return fn(std::type_identity<char>{});
+      case Type::String: return fn(std::type_identity<std::string_view>{});
+      case Type::BigInt: return fn(std::type_identity<int64_t>{});
+      case Type::Bool: return fn(std::type_identity<bool>{});
+      case Type::Date: return fn(std::type_identity<date>{});
+      default: throw std::logic_error("unknown type");
+   }
+}
+
+// call fn with std::integral_constant of op
+template<typename Fn>
+decltype(auto) dispatchCmp(CmpOp op, Fn&& fn) {
+   switch (op) {
+      case CmpOp::Eq: return fn(std::integral_constant<CmpOp, CmpOp::Eq>{});
+      case CmpOp::Ne: return fn(std::integral_constant<CmpOp, CmpOp::Ne>{});
+      case CmpOp::Lt: return fn(std::integral_constant<CmpOp, CmpOp::Lt>{});
+      case CmpOp::Le: return fn(std::integral_constant<CmpOp, CmpOp::Le>{});
+      case CmpOp::Gt: return fn(std::integral_constant<CmpOp, CmpOp::Gt>{});
+      default: return fn(std::integral_constant<CmpOp, CmpOp::Ge>{});
+   }
+}
+
+// operator of a comparison with swapped arguments (c op x <=> x swapped(op) c)
+inline CmpOp swapped(CmpOp op) {
+   switch (op) {
+      case CmpOp::Lt: return CmpOp::Gt;
+      case CmpOp::Le: return CmpOp::Ge;
+      case CmpOp::Gt: return CmpOp::Lt;
+      case CmpOp::Ge: return CmpOp::Le;
+      default: return op;
+   }
+}
+
+inline unsigned typeWidth(Type t) {
+   return dispatchType(t, [](auto tag) -> unsigned { return sizeof(typename decltype(tag)::type); });
+}
+
+// type both operands of a binary operation are converted to
+inline Type commonType(Type a, Type b) {
+   if (a == b)
+      return a;
+   // dates may be compared with their integer representation
+   if ((a == Type::Date && b == Type::Integer) || (a == Type::Integer && b == Type::Date))
+      return Type::Date;
+   if (a == Type::Double || b == Type::Double)
+      return Type::Double;
+   if ((a == Type::BigInt || b == Type::BigInt) && (a == Type::Integer || b == Type::Integer))
+      return Type::BigInt;
+   throw std::logic_error("incompatible types " + tname(a) + " and " + tname(b));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// values of one column for the rows of a chunk; a constant holds one value for all rows
+struct Vector {
+   Type type = Type::Undefined;
+   const void* data = nullptr;
+   bool constant = false;
+   // owns data unless it points into the database or a buffer
+   std::shared_ptr<std::vector<std::byte>> storage;
+
+   template<typename T>
+   const T* values() const {
+      return static_cast<const T*>(data);
+   }
+   template<typename T>
+   T at(uint64_t i) const {
+      return values<T>()[constant ? 0 : i];
+   }
+
+   // uninitialized vector of n values
+   template<typename T>
+   static Vector allocate(uint64_t n, T*& out) {
+      Vector v;
+      v.type = type_tag<T>::tag;
+      v.storage = std::make_shared<std::vector<std::byte>>(std::max<uint64_t>(n, 1) * sizeof(T));
+      out = reinterpret_cast<T*>(v.storage->data());
+      v.data = out;
+      return v;
+   }
+   template<typename T>
+   static Vector constantOf(T value) {
+      T* out;
+      Vector v = allocate<T>(1, out);
+      *out = value;
+      v.constant = true;
+      return v;
+   }
+   // non-owning vector of n values of type t
+   static Vector view(Type t, const void* data) { return Vector{t, data, false, nullptr}; }
+};
+
+// growable column of materialized values (state of pipeline breakers)
+struct ColumnBuffer {
+   Type type;
+   unsigned width;
+   std::vector<std::byte> bytes;
+
+   explicit ColumnBuffer(Type type) : type(type), width(typeWidth(type)) {}
+
+   uint64_t size() const { return bytes.size() / width; }
+   const std::byte* data() const { return bytes.data(); }
+
+   template<typename T>
+   const T* values() const {
+      return reinterpret_cast<const T*>(bytes.data());
+   }
+
+   // append the first n values of v
+   void append(const Vector& v, uint64_t n) {
+      uint64_t old = bytes.size();
+      bytes.resize(old + n * width);
+      if (!v.constant) {
+         memcpy(bytes.data() + old, v.data, n * width);
+         return;
+      }
+      for (uint64_t i = 0; i != n; i++)
+         memcpy(bytes.data() + old + i * width, v.data, width);
+   }
+
+   // vector of the n values starting at row begin
+   Vector view(uint64_t begin) const { return Vector::view(type, bytes.data() + begin * width); }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Primitives on vectors
+
+// gather values at positions rows[0..n) of values into a new vector
+template<typename T, typename Pos>
+inline void gatherValues(const T* values, const Pos* rows, uint64_t n, T* out) {
+   for (uint64_t i = 0; i != n; i++)
+      out[i] = values[rows[i]];
+}
+
+template<typename Pos>
+inline Vector gather(const Vector& v, const Pos* rows, uint64_t n) {
+   if (v.constant)
+      return v;
+   return dispatchType(v.type, [&](auto tag) {
+      using T = typename decltype(tag)::type;
+      T* out;
+      Vector result = Vector::allocate<T>(n, out);
+      gatherValues(v.values<T>(), rows, n, out);
+      return result;
+   });
+}
+
+template<typename Pos>
+inline Vector gather(const ColumnBuffer& buffer, const Pos* rows, uint64_t n) {
+   return gather(buffer.view(0), rows, n);
+}
+
+// convert the first n values of v to type t
+inline Vector cast(const Vector& v, Type t, uint64_t n) {
+   if (v.type == t)
+      return v;
+   uint64_t count = v.constant ? 1 : n;
+   return dispatchType(v.type, [&](auto from) {
+      using From = typename decltype(from)::type;
+      return dispatchType(t, [&](auto to) -> Vector {
+         using To = typename decltype(to)::type;
+         if constexpr (std::is_same_v<From, date> && std::is_same_v<To, int32_t>) {
+            return Vector{t, v.data, v.constant, v.storage};
+         } else if constexpr (std::is_same_v<From, int32_t> && std::is_same_v<To, date>) {
+            return Vector{t, v.data, v.constant, v.storage};
+         } else if constexpr (std::is_arithmetic_v<From> && std::is_arithmetic_v<To>) {
+            To* out;
+            Vector result = Vector::allocate<To>(count, out);
+            for (uint64_t i = 0; i != count; i++)
+               out[i] = static_cast<To>(v.values<From>()[i]);
+            result.constant = v.constant;
+            return result;
+         } else {
+            throw std::logic_error("cannot convert " + tname(v.type) + " to " + tname(t));
+         }
+      });
+   });
+}
+
+// compare the first n values of a and b (same type), result is a Bool vector
+inline Vector compare(CmpOp op, const Vector& a, const Vector& b, uint64_t n) {
+   return dispatchType(a.type, [&](auto tag) {
+      using T = typename decltype(tag)::type;
+      return dispatchCmp(op, [&](auto cmp) {
+         bool* out;
+         Vector result = Vector::allocate<bool>(n, out);
+         for (uint64_t i = 0; i != n; i++)
+            out[i] = p2c::compare<cmp.value>(a.at<T>(i), b.at<T>(i));
+         return result;
+      });
+   });
+}
+
+// reduce the selection vector sel of length count (or all n rows if dense) to the rows where 'a op b' holds, returns the new length
+inline uint32_t select(CmpOp op, const Vector& a, const Vector& b, uint32_t* sel, uint32_t count, bool dense) {
+   if (a.constant && !b.constant)
+      return select(swapped(op), b, a, sel, count, dense);
+   return dispatchType(a.type, [&](auto tag) {
+      using T = typename decltype(tag)::type;
+      return dispatchCmp(op, [&](auto cmp) {
+         const T* values = a.values<T>();
+         // column compared with a constant: SIMD kernels where available
+         if constexpr (!std::is_same_v<T, std::string_view> && !std::is_same_v<T, bool>) {
+            if (b.constant)
+               return dense ? selectDense<cmp.value>(values, count, b.at<T>(0), sel) : selectSparse<cmp.value>(values, sel, count, b.at<T>(0));
+         }
+         uint32_t selected = 0;
+         for (uint32_t k = 0; k != count; k++) {
+            uint32_t pos = dense ? k : sel[k];
+            sel[selected] = pos;
+            selected += p2c::compare<cmp.value>(a.at<T>(pos), b.at<T>(pos));
+         }
+         return selected;
+      });
+   });
+}
+
+// reduce the selection vector to the rows where the Bool vector v is true
+inline uint32_t selectTrue(const Vector& v, uint32_t* sel, uint32_t count, bool dense) {
+   uint32_t selected = 0;
+   for (uint32_t k = 0; k != count; k++) {
+      uint32_t pos = dense ? k : sel[k];
+      sel[selected] = pos;
+      selected += v.at<bool>(pos);
+   }
+   return selected;
+}
+
+// arithmetic and logical operators of binary expressions
+enum class BinaryOp : uint8_t { Plus, Minus, Multiplies, Divides, And, Or };
+
+template<BinaryOp op, typename T>
+inline T apply(T a, T b) {
+   if constexpr (op == BinaryOp::Plus)
+      return a + b;
+   else if constexpr (op == BinaryOp::Minus)
+      return a - b;
+   else if constexpr (op == BinaryOp::Multiplies && std::is_same_v<T, bool>)
+      return a && b;
+   else if constexpr (op == BinaryOp::Multiplies)
+      return a * b;
+   else if constexpr (op == BinaryOp::Divides)
+      return a / b;
+   else if constexpr (op == BinaryOp::And)
+      return a && b;
+   else
+      return a || b;
+}
+
+// 'a op b' for the first n values of a and b (same type)
+inline Vector binary(BinaryOp op, const Vector& a, const Vector& b, uint64_t n) {
+   uint64_t count = a.constant && b.constant ? 1 : n;
+   return dispatchType(a.type, [&](auto tag) -> Vector {
+      using T = typename decltype(tag)::type;
+      if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, char>) {
+         auto run = [&](auto opTag) {
+            T* out;
+            Vector result = Vector::allocate<T>(count, out);
+            for (uint64_t i = 0; i != count; i++)
+               out[i] = apply<opTag.value>(a.at<T>(i), b.at<T>(i));
+            result.constant = a.constant && b.constant;
+            return result;
+         };
+         switch (op) {
+            case BinaryOp::Plus: return run(std::integral_constant<BinaryOp, BinaryOp::Plus>{});
+            case BinaryOp::Minus: return run(std::integral_constant<BinaryOp, BinaryOp::Minus>{});
+            case BinaryOp::Multiplies: return run(std::integral_constant<BinaryOp, BinaryOp::Multiplies>{});
+            case BinaryOp::Divides: return run(std::integral_constant<BinaryOp, BinaryOp::Divides>{});
+            case BinaryOp::And: return run(std::integral_constant<BinaryOp, BinaryOp::And>{});
+            default: return run(std::integral_constant<BinaryOp, BinaryOp::Or>{});
+         }
+      } else {
+         throw std::logic_error("no arithmetic on " + tname(a.type));
+      }
+   });
+}
+
+// combine the hashes of n rows with the values of v (first: initialize hashes), same hash as hashKey
+inline void hashValues(const Vector& v, uint64_t n, uint64_t* hashes, bool first) {
+   dispatchType(v.type, [&](auto tag) {
+      using T = typename decltype(tag)::type;
+      for (uint64_t i = 0; i != n; i++)
+         hashes[i] = hashMix((first ? 0 : hashes[i]) ^ hashValue(v.at<T>(i)));
+   });
+}
+
+// keep the (probe row, buffer row) pairs whose values are equal, returns the new number of pairs
+inline uint32_t keepEqual(const Vector& v, const ColumnBuffer& buffer, uint32_t* rows, uint64_t* bufferRows, uint32_t count) {
+   return dispatchType(v.type, [&](auto tag) {
+      using T = typename decltype(tag)::type;
+      const T* other = buffer.values<T>();
+      uint32_t kept = 0;
+      for (uint32_t k = 0; k != count; k++) {
+         rows[kept] = rows[k];
+         bufferRows[kept] = bufferRows[k];
+         kept += v.at<T>(rows[k]) == other[bufferRows[k]];
+      }
+      return kept;
+   });
+}
+
+// three-way comparison of two rows of a buffer
+using RowCompareFn = int (*)(const ColumnBuffer& buffer, uint64_t a, uint64_t b);
+
+inline RowCompareFn rowCompare(Type t) {
+   return dispatchType(t, [](auto tag) -> RowCompareFn {
+      using T = typename decltype(tag)::type;
+      return [](const ColumnBuffer& buffer, uint64_t a, uint64_t b) {
+         const T* values = buffer.values<T>();
+         return values[a] < values[b] ? -1 : values[b] < values[a] ? 1 : 0;
+      };
+   });
+}
+
+// write value i of v
+inline void printValue(std::ostream& out, const Vector& v, uint64_t i) {
+   dispatchType(v.type, [&](auto tag) {
+      using T = typename decltype(tag)::type;
+      out << v.at<T>(i);
+   });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Hash tables of the interpreter
+
+// chained hash table over the materialized rows of a join's build side
+class RowHashTable {
+   std::vector<uint64_t> hashes;
+   // first row + 1 of each bucket's chain and next row + 1 of each row (0 ends a chain)
+   std::vector<uint64_t> heads, next;
+   uint64_t mask = 0;
+
+public:
+   explicit RowHashTable(std::vector<uint64_t>&& rowHashes) : hashes(std::move(rowHashes)), next(hashes.size()) {
+      uint64_t buckets = std::bit_ceil(std::max<uint64_t>(hashes.size() * 2, 16));
+      heads.resize(buckets);
+      mask = buckets - 1;
+      for (uint64_t row = 0; row != hashes.size(); row++) {
+         uint64_t& head = heads[hashes[row] & mask];
+         next[row] = head;
+         head = row + 1;
+      }
+   }
+
+   // pairs of (probe row, build row) with equal hashes; the keys still have to be compared
+   void candidates(const uint64_t* probeHashes, uint32_t n, std::vector<uint32_t>& rows, std::vector<uint64_t>& buildRows) const {
+      rows.clear();
+      buildRows.clear();
+      for (uint32_t i = 0; i != n; i++)
+         for (uint64_t entry = heads[probeHashes[i] & mask]; entry; entry = next[entry - 1])
+            if (hashes[entry - 1] == probeHashes[i]) {
+               rows.push_back(i);
+               buildRows.push_back(entry - 1);
+            }
+   }
+};
+
+// hash table mapping group keys to dense group ids (group by)
+class GroupTable {
+   std::vector<uint64_t> hashes;
+   // first group + 1 of each bucket's chain and next group + 1 of each group (0 ends a chain)
+   std::vector<uint32_t> heads, next;
+   uint64_t mask = 0;
+
+   void grow() {
+      uint64_t buckets = std::bit_ceil(std::max<uint64_t>(hashes.size() * 4, 1024));
+      heads.assign(buckets, 0);
+      mask = buckets - 1;
+      for (uint32_t g = 0; g != hashes.size(); g++) {
+         next[g] = heads[hashes[g] & mask];
+         heads[hashes[g] & mask] = g + 1;
+      }
+   }
+
+   bool equalKeys(const std::vector<Vector>& keyVectors, uint32_t row, uint32_t group) const {
+      for (unsigned k = 0; k != keys.size(); k++) {
+         bool equal = dispatchType(keys[k].type, [&](auto tag) {
+            using T = typename decltype(tag)::type;
+            return keyVectors[k].at<T>(row) == keys[k].values<T>()[group];
+         });
+         if (!equal)
+            return false;
+      }
+      return true;
+   }
+
+public:
+   // key values of every group
+   std::vector<ColumnBuffer> keys;
+
+   explicit GroupTable(const std::vector<Type>& keyTypes) {
+      for (Type t : keyTypes)
+         keys.emplace_back(t);
+      grow();
+   }
+
+   uint32_t groupCount() const { return hashes.size(); }
+
+   // group id of each of the n rows; rows that create a new group are appended to created
+   void findOrInsert(const std::vector<Vector>& keyVectors, const uint64_t* rowHashes, uint32_t n, uint32_t* groups, std::vector<uint32_t>& created) {
+      created.clear();
+      for (uint32_t i = 0; i != n; i++) {
+         uint32_t entry = heads[rowHashes[i] & mask];
+         while (entry && (hashes[entry - 1] != rowHashes[i] || !equalKeys(keyVectors, i, entry - 1)))
+            entry = next[entry - 1];
+         if (entry) {
+            groups[i] = entry - 1;
+            continue;
+         }
+         // new group
+         uint32_t g = hashes.size();
+         hashes.push_back(rowHashes[i]);
+         next.push_back(heads[rowHashes[i] & mask]);
+         heads[rowHashes[i] & mask] = g + 1;
+         for (unsigned k = 0; k != keys.size(); k++) {
+            uint32_t row = i;
+            keys[k].append(gather(keyVectors[k], &row, 1), 1);
+         }
+         groups[i] = g;
+         created.push_back(i);
+         if (hashes.size() * 2 > heads.size())
+            grow();
+      }
+   }
+};
+
+// aggregate functions of group by
+enum class AggFn : uint8_t { Count, Min, Sum };
+
+// update the aggregates of groups with the n values of v (same type as the state)
+// rows in created start a new group: Min starts with their value, Count and Sum with 0
+inline void aggregate(AggFn fn, ColumnBuffer& state, const Vector& v, const uint32_t* groups, uint32_t n, const std::vector<uint32_t>& created, uint32_t groupCount) {
+   dispatchType(state.type, [&](auto tag) {
+      using T = typename decltype(tag)::type;
+      state.bytes.resize(groupCount * sizeof(T));
+      T* values = reinterpret_cast<T*>(state.bytes.data());
+      for (uint32_t row : created)
+         values[groups[row]] = fn == AggFn::Min ? v.at<T>(row) : T{};
+      if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char>) {
+         if (fn == AggFn::Count) {
+            for (uint32_t i = 0; i != n; i++)
+               values[groups[i]] += 1;
+            return;
+         }
+         if (fn == AggFn::Sum) {
+            for (uint32_t i = 0; i != n; i++)
+               values[groups[i]] += v.at<T>(i);
+            return;
+         }
+      }
+      if (fn != AggFn::Min)
+         throw std::logic_error("cannot aggregate " + tname(state.type));
+      for (uint32_t i = 0; i != n; i++)
+         values[groups[i]] = std::min(values[groups[i]], v.at<T>(i));
+   });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// columns of the database opened by name (the interpreter cannot use the members of TPCH)
+class ColumnStore : DatabaseAutoload {
+   std::map<std::string, std::shared_ptr<void>> columns;
+   std::map<std::string, std::shared_ptr<void>> stats;
+
+public:
+   using DatabaseAutoload::DatabaseAutoload;
+
+   template<typename T>
+   const DataColumnFile<T>& column(const std::string& relation, const std::string& name) {
+      auto& entry = columns[relation + "." + name];
+      if (!entry) {
+         Relation rel(this, relation);
+         entry = std::make_shared<DataColumnFile<T>>(&rel, name);
+      }
+      return *static_cast<const DataColumnFile<T>*>(entry.get());
+   }
+
+   // statistics of a column written by the data generator, nullptr if there are none
+   template<typename T>
+   const ColumnStats<T>* columnStats(const std::string& relation, const std::string& name) {
+      auto [it, inserted] = stats.try_emplace(relation + "." + name);
+      if (inserted)
+         if (auto s = loadStats<T>(relation, name))
+            it->second = std::make_shared<ColumnStats<T>>(std::move(*s));
+      return static_cast<const ColumnStats<T>*>(it->second.get());
+   }
+
+   // values of rows [begin, begin + n) of a column
+   Vector scan(const std::string& relation, const std::string& name, Type t, uint64_t begin, uint64_t n) {
+      return dispatchType(t, [&](auto tag) {
+         using T = typename decltype(tag)::type;
+         auto& col = column<T>(relation, name);
+         if constexpr (std::is_same_v<T, std::string_view>) {
+            std::string_view* out;
+            Vector v = Vector::allocate<std::string_view>(n, out);
+            for (uint64_t i = 0; i != n; i++)
+               out[i] = col[begin + i];
+            return v;
+         } else {
+            return Vector::view(t, col.data() + begin);
+         }
+      });
+   }
+
+   // mapped file of a column (for strings: the count followed by the slots and the string data)
+   const void* data(const std::string& relation, const std::string& name, Type t) {
+      return dispatchType(t, [&](auto tag) -> const void* { return column<typename decltype(tag)::type>(relation, name).data(); });
+   }
+
+   uint64_t tupleCount(const std::string& relation, const std::string& firstColumn, Type t) {
+      return dispatchType(t, [&](auto tag) -> uint64_t { return column<typename decltype(tag)::type>(relation, firstColumn).size(); });
+   }
+};
+
+}  // namespace p2c
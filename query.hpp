@@ -0,0 +1,26 @@
+#pragma once
+
+// headers and namespaces available to generated query code
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "cardinalities.hpp"
+#include "hashtable.hpp"
+#include "parallel.hpp"
+#include "params.hpp"
+#include "simd.hpp"
+#include "sort.hpp"
+#include "tiering.hpp"
+#include "tpch.hpp"
+
+using namespace std;
+using namespace p2c;
@@ -1,20 +1,9 @@
-#include <algorithm>
-#include <cassert>
-#include <functional>
-#include <iostream>
-#include <string>
-#include <tuple>
-#include <unordered_map>
-#include <vector>
-
-#include "tpch.hpp"
-
-using namespace std;
-using namespace p2c;
+#include "query.hpp"
 
 int main(int argc, char** argv) {
    TPCH db(argc >= 2 ? argv[1] : "data-generator/output/");
    unsigned run_count = argc >= 3 ? atoi(argv[2]) : 1;
+   ThreadPool pool(argc >= 4 ? atoi(argv[3]) : thread::hardware_concurrency());
    for (unsigned run = 0; run < run_count; ++run) {
 #include "gen.cpp"
    }
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <type_traits>
+
+#include "types.hpp"
+
+#if defined(__AVX512F__) && defined(__AVX512VL__) && defined(__AVX512BW__)
+#define P2C_AVX512
+#include <immintrin.h>
+#elif defined(__AVX2__)
+#define P2C_AVX2
+#include <immintrin.h>
+#endif
+
+namespace p2c {
+
+////////////////////////////////////////////////////////////////////////////////
+// Predicate kernels: compare a column with a constant and produce a selection
+// vector (positions of the qualifying rows). Uses AVX-512 or AVX2 depending on
+// the target (-march=native), with a scalar fallback.
+
+// comparison operator of a predicate
+enum class CmpOp : uint8_t { Eq, Ne, Lt, Le, Gt, Ge };
+
+template<CmpOp op, typename T>
+inline bool compare(const T& a, const T& b) {
+   if constexpr (op == CmpOp::Eq)
+      return a == b;
+   else if constexpr (op == CmpOp::Ne)
+      return a != b;
+   else if constexpr (op == CmpOp::Lt)
+      return a < b;
+   else if constexpr (op == CmpOp::Le)
+      return a <= b;
+   else if constexpr (op == CmpOp::Gt)
+      return a > b;
+   else
+      return a >= b;
+}
+
+namespace simd {
+
+#if defined(P2C_AVX512)
+
+// number of rows compared at once
+static constexpr unsigned width = 16;
+using Mask = __mmask16;
+
+// predicate immediates of the compare instructions
+template<CmpOp op>
+constexpr int intPredicate = op == CmpOp::Eq ? _MM_CMPINT_EQ : op == CmpOp::Ne ? _MM_CMPINT_NE : op == CmpOp::Lt ? _MM_CMPINT_LT : op == CmpOp::Le ? _MM_CMPINT_LE : op == CmpOp::Gt ? _MM_CMPINT_NLE : _MM_CMPINT_NLT;
+
+template<CmpOp op>
+constexpr int fpPredicate = op == CmpOp::Eq ? _CMP_EQ_OQ : op == CmpOp::Ne ? _CMP_NEQ_UQ : op == CmpOp::Lt ? _CMP_LT_OQ : op == CmpOp::Le ? _CMP_LE_OQ : op == CmpOp::Gt ? _CMP_GT_OQ : _CMP_GE_OQ;
+
+// compare 16 values
+template<CmpOp op>
+inline Mask cmp(__m512i v, int32_t c) { return _mm512_cmp_epi32_mask(v, _mm512_set1_epi32(c), intPredicate<op>); }
+template<CmpOp op>
+inline Mask cmp(__m512i lo, __m512i hi, int64_t c) {
+   __m512i cv = _mm512_set1_epi64(c);
+   return _mm512_cmp_epi64_mask(lo, cv, intPredicate<op>) | (_mm512_cmp_epi64_mask(hi, cv, intPredicate<op>) << 8);
+}
+template<CmpOp op>
+inline Mask cmp(__m512d lo, __m512d hi, double c) {
+   __m512d cv = _mm512_set1_pd(c);
+   return _mm512_cmp_pd_mask(lo, cv, fpPredicate<op>) | (_mm512_cmp_pd_mask(hi, cv, fpPredicate<op>) << 8);
+}
+
+// compare 16 consecutive values
+template<CmpOp op>
+inline Mask cmpBlock(const int32_t* p, int32_t c) { return cmp<op>(_mm512_loadu_si512(p), c); }
+template<CmpOp op>
+inline Mask cmpBlock(const int64_t* p, int64_t c) { return cmp<op>(_mm512_loadu_si512(p), _mm512_loadu_si512(p + 8), c); }
+template<CmpOp op>
+inline Mask cmpBlock(const double* p, double c) { return cmp<op>(_mm512_loadu_pd(p), _mm512_loadu_pd(p + 8), c); }
+template<CmpOp op>
+inline Mask cmpBlock(const char* p, char c) {
+   return _mm_cmp_epi8_mask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), _mm_set1_epi8(c), intPredicate<op>);
+}
+
+// compare the values at the 16 positions sel[0..15]
+template<CmpOp op>
+inline Mask cmpGather(const int32_t* p, const uint32_t* sel, int32_t c) {
+   return cmp<op>(_mm512_mask_i32gather_epi32(_mm512_setzero_si512(), 0xffff, _mm512_loadu_si512(sel), p, 4), c);
+}
+template<CmpOp op>
+inline Mask cmpGather(const int64_t* p, const uint32_t* sel, int64_t c) {
+   __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sel)), hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sel + 8));
+   return cmp<op>(_mm512_mask_i32gather_epi64(_mm512_setzero_si512(), 0xff, lo, p, 8), _mm512_mask_i32gather_epi64(_mm512_setzero_si512(), 0xff, hi, p, 8), c);
+}
+template<CmpOp op>
+inline Mask cmpGather(const double* p, const uint32_t* sel, double c) {
+   __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sel)), hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sel + 8));
+   return cmp<op>(_mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xff, lo, p, 8), _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xff, hi, p, 8), c);
+}
+
+inline __m512i loadPositions(const uint32_t* sel) { return _mm512_loadu_si512(sel); }
+inline __m512i blockPositions(uint32_t begin) { return _mm512_add_epi32(_mm512_set1_epi32(begin), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)); }
+
+// append the positions whose mask bit is set to sel
+inline uint32_t storePositions(uint32_t* sel, uint32_t count, __m512i pos, Mask m) {
+   _mm512_mask_compressstoreu_epi32(sel + count, m, pos);
+   return count + std::popcount(m);
+}
+
+#elif defined(P2C_AVX2)
+
+// number of rows compared at once
+static constexpr unsigned width = 8;
+using Mask = uint32_t;
+
+// AVX2 only has == and > for integers, the other comparisons are derived
+template<CmpOp op, unsigned bits, typename V, typename Eq, typename Gt, typename Movemask>
+inline Mask cmpInt(V v, V cv, Eq eq, Gt gt, Movemask movemask) {
+   Mask m;
+   if constexpr (op == CmpOp::Eq || op == CmpOp::Ne)
+      m = movemask(eq(v, cv));
+   else if constexpr (op == CmpOp::Gt || op == CmpOp::Le)
+      m = movemask(gt(v, cv));
+   else
+      m = movemask(gt(cv, v));
+   if constexpr (op == CmpOp::Ne || op == CmpOp::Le || op == CmpOp::Ge)
+      m ^= (1u << bits) - 1;
+   return m;
+}
+
+inline auto eq32 = [](__m256i a, __m256i b) { return _mm256_cmpeq_epi32(a, b); };
+inline auto gt32 = [](__m256i a, __m256i b) { return _mm256_cmpgt_epi32(a, b); };
+inline auto movemask32 = [](__m256i v) -> Mask { return _mm256_movemask_ps(_mm256_castsi256_ps(v)); };
+inline auto eq64 = [](__m256i a, __m256i b) { return _mm256_cmpeq_epi64(a, b); };
+inline auto gt64 = [](__m256i a, __m256i b) { return _mm256_cmpgt_epi64(a, b); };
+inline auto movemask64 = [](__m256i v) -> Mask { return _mm256_movemask_pd(_mm256_castsi256_pd(v)); };
+inline auto eq8 = [](__m128i a, __m128i b) { return _mm_cmpeq_epi8(a, b); };
+inline auto gt8 = [](__m128i a, __m128i b) { return _mm_cmpgt_epi8(a, b); };
+inline auto movemask8 = [](__m128i v) -> Mask { return _mm_movemask_epi8(v) & 0xff; };
+
+// predicate immediates of the compare instructions
+template<CmpOp op>
+constexpr int fpPredicate = op == CmpOp::Eq ? _CMP_EQ_OQ : op == CmpOp::Ne ? _CMP_NEQ_UQ : op == CmpOp::Lt ? _CMP_LT_OQ : op == CmpOp::Le ? _CMP_LE_OQ : op == CmpOp::Gt ? _CMP_GT_OQ : _CMP_GE_OQ;
+
+// compare 8 values
+template<CmpOp op>
+inline Mask cmp(__m256i v, int32_t c) {
+   return cmpInt<op, 8>(v, _mm256_set1_epi32(c), eq32, gt32, movemask32);
+}
+template<CmpOp op>
+inline Mask cmp(__m256i lo, __m256i hi, int64_t c) {
+   __m256i cv = _mm256_set1_epi64x(c);
+   return cmpInt<op, 4>(lo, cv, eq64, gt64, movemask64) | (cmpInt<op, 4>(hi, cv, eq64, gt64, movemask64) << 4);
+}
+template<CmpOp op>
+inline Mask cmp(__m256d lo, __m256d hi, double c) {
+   __m256d cv = _mm256_set1_pd(c);
+   return _mm256_movemask_pd(_mm256_cmp_pd(lo, cv, fpPredicate<op>)) | (_mm256_movemask_pd(_mm256_cmp_pd(hi, cv, fpPredicate<op>)) << 4);
+}
+
+// compare 8 consecutive values
+template<CmpOp op>
+inline Mask cmpBlock(const int32_t* p, int32_t c) { return cmp<op>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), c); }
+template<CmpOp op>
+inline Mask cmpBlock(const int64_t* p, int64_t c) {
+   return cmp<op>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 4)), c);
+}
+template<CmpOp op>
+inline Mask cmpBlock(const double* p, double c) { return cmp<op>(_mm256_loadu_pd(p), _mm256_loadu_pd(p + 4), c); }
+template<CmpOp op>
+inline Mask cmpBlock(const char* p, char c) {
+   return cmpInt<op, 8>(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_set1_epi8(c), eq8, gt8, movemask8);
+}
+
+inline __m256i loadPositions(const uint32_t* sel) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sel)); }
+
+// compare the values at the 8 positions sel[0..7]
+template<CmpOp op>
+inline Mask cmpGather(const int32_t* p, const uint32_t* sel, int32_t c) {
+   return cmp<op>(_mm256_mask_i32gather_epi32(_mm256_setzero_si256(), p, loadPositions(sel), _mm256_set1_epi32(-1), 4), c);
+}
+template<CmpOp op>
+inline Mask cmpGather(const int64_t* p, const uint32_t* sel, int64_t c) {
+   auto q = reinterpret_cast<const long long*>(p);
+   __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sel)), hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sel + 4));
+   __m256i all = _mm256_set1_epi64x(-1);
+   return cmp<op>(_mm256_mask_i32gather_epi64(_mm256_setzero_si256(), q, lo, all, 8), _mm256_mask_i32gather_epi64(_mm256_setzero_si256(), q, hi, all, 8), c);
+}
+template<CmpOp op>
+inline Mask cmpGather(const double* p, const uint32_t* sel, double c) {
+   __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sel)), hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sel + 4));
+   __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+   return cmp<op>(_mm256_mask_i32gather_pd(_mm256_setzero_pd(), p, lo, all, 8), _mm256_mask_i32gather_pd(_mm256_setzero_pd(), p, hi, all, 8), c);
+}
+
+inline __m256i blockPositions(uint32_t begin) { return _mm256_add_epi32(_mm256_set1_epi32(begin), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)); }
+
+// for each 8-bit mask, the indexes of its set bits (one byte each)
+inline constexpr auto compressTable = []() {
+   struct {
+      uint64_t v[256];
+   } table{};
+   for (unsigned m = 0; m != 256; m++)
+      for (unsigned i = 0, n = 0; i != 8; i++)
+         if (m & (1u << i))
+            table.v[m] |= uint64_t(i) << (8 * n++);
+   return table;
+}();
+
+// append the positions whose mask bit is set to sel (writes 8 entries, the ones beyond the new count are garbage)
+inline uint32_t storePositions(uint32_t* sel, uint32_t count, __m256i pos, Mask m) {
+   __m256i perm = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(compressTable.v[m]));
+   _mm256_storeu_si256(reinterpret_cast<__m256i*>(sel + count), _mm256_permutevar8x32_epi32(pos, perm));
+   return count + std::popcount(m);
+}
+
+#endif
+
+// kernels work on the underlying representation of dates
+template<typename T>
+using Repr = std::conditional_t<std::is_same_v<T, date>, int32_t, T>;
+
+}  // namespace simd
+
+// select the rows [0, n) of column that satisfy 'column[i] op c' into sel, returns the number of selected rows
+template<CmpOp op, typename T>
+uint32_t selectDense(const T* column, uint32_t n, std::type_identity_t<T> c, uint32_t* sel) {
+   uint32_t count = 0, i = 0;
+#if defined(P2C_AVX512) || defined(P2C_AVX2)
+   using R = simd::Repr<T>;
+   auto values = reinterpret_cast<const R*>(column);
+   R constant = std::bit_cast<R>(c);
+   for (; i + simd::width <= n; i += simd::width)
+      count = simd::storePositions(sel, count, simd::blockPositions(i), simd::cmpBlock<op>(values + i, constant));
+#endif
+   for (; i != n; i++) {
+      sel[count] = i;
+      count += compare<op>(column[i], c);
+   }
+   return count;
+}
+
+// reduce the selection vector sel of length count to the rows that satisfy 'column[sel[k]] op c', returns the new length
+template<CmpOp op, typename T>
+uint32_t selectSparse(const T* column, uint32_t* sel, uint32_t count, std::type_identity_t<T> c) {
+   uint32_t selected = 0, k = 0;
+#if defined(P2C_AVX512) || defined(P2C_AVX2)
+   using R = simd::Repr<T>;
+   // there is no gather for bytes
+   if constexpr (!std::is_same_v<R, char>) {
+      auto values = reinterpret_cast<const R*>(column);
+      R constant = std::bit_cast<R>(c);
+      for (; k + simd::width <= count; k += simd::width) {
+         auto mask = simd::cmpGather<op>(values, sel + k, constant);
+         selected = simd::storePositions(sel, selected, simd::loadPositions(sel + k), mask);
+      }
+   }
+#endif
+   for (; k != count; k++) {
+      uint32_t pos = sel[k];
+      sel[selected] = pos;
+      selected += compare<op>(column[pos], c);
+   }
+   return selected;
+}
+
+}  // namespace p2c
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "parallel.hpp"
+#include "types.hpp"
+
+namespace p2c {
+
+////////////////////////////////////////////////////////////////////////////////
+// Normalized keys: sort keys encoded as byte strings whose memcmp order is the
+// sort order. Fixed-size values are stored big-endian with the sign bit
+// flipped, strings as a zero-padded prefix, descending keys with all bits
+// inverted.
+
+// number of bytes of a string's prefix in a normalized key
+static constexpr unsigned stringKeyPrefix = 16;
+
+template<typename T>
+inline void storeBigEndian(T v, uint8_t* out) {
+   if constexpr (std::endian::native == std::endian::little)
+      v = std::byteswap(v);
+   memcpy(out, &v, sizeof(T));
+}
+
+inline void encodeKey(int32_t v, uint8_t* out) { storeBigEndian(static_cast<uint32_t>(v) ^ 0x80000000u, out); }
+inline void encodeKey(int64_t v, uint8_t* out) { storeBigEndian(static_cast<uint64_t>(v) ^ 0x8000000000000000ull, out); }
+inline void encodeKey(date v, uint8_t* out) { encodeKey(v.value, out); }
+inline void encodeKey(char v, uint8_t* out) { *out = static_cast<uint8_t>(v) ^ 0x80; }
+inline void encodeKey(bool v, uint8_t* out) { *out = v; }
+inline void encodeKey(double v, uint8_t* out) {
+   // negative numbers: invert all bits, positive numbers: flip the sign bit
+   uint64_t bits = std::bit_cast<uint64_t>(v);
+   storeBigEndian(bits & 0x8000000000000000ull ? ~bits : bits ^ 0x8000000000000000ull, out);
+}
+inline void encodeKey(std::string_view v, uint8_t* out) {
+   unsigned len = std::min<size_t>(v.size(), stringKeyPrefix);
+   memcpy(out, v.data(), len);
+   memset(out + len, 0, stringKeyPrefix - len);
+}
+
+// reverse the order of an encoded key
+inline void invertKey(uint8_t* out, unsigned width) {
+   for (unsigned i = 0; i != width; i++)
+      out[i] = ~out[i];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// parallel sort of tuples collected by the workers
+//
+// Each worker sorts its own run of (normalized key, row pointer) entries: runs
+// are partitioned by the first key byte (MSB radix pass) and the buckets are
+// sorted with std::sort on the memcmp order. The runs are then cut into
+// disjoint key ranges using splitters sampled from all runs and the ranges are
+// merged in parallel. If the normalized key is not exact (it ends with a string
+// prefix, later keys are not encoded),
+// ties are broken with the full comparator.
+template<typename Tuple, unsigned keyBytes>
+class ParallelSort {
+public:
+   struct Entry {
+      std::array<uint8_t, keyBytes> key;
+      const Tuple* row;
+   };
+
+private:
+   PerWorker<std::vector<Tuple>> tuples;
+   PerWorker<std::vector<Entry>> runs;
+   std::vector<const Tuple*> result;
+
+   // runs smaller than this are sorted with std::sort only
+   static constexpr uint64_t radixThreshold = 4096;
+   // number of merge partitions per worker (for load balancing)
+   static constexpr unsigned partitionsPerWorker = 4;
+
+   template<typename Cmp>
+   static bool less(const Entry& a, const Entry& b, const Cmp& cmp, bool exact) {
+      int c = memcmp(a.key.data(), b.key.data(), keyBytes);
+      if (c || exact)
+         return c < 0;
+      return cmp(*a.row, *b.row);
+   }
+
+   template<typename Cmp>
+   static void sortRun(std::vector<Entry>& run, const Cmp& cmp, bool exact) {
+      auto lessFn = [&](const Entry& a, const Entry& b) { return less(a, b, cmp, exact); };
+      if (run.size() < radixThreshold) {
+         std::sort(run.begin(), run.end(), lessFn);
+         return;
+      }
+      // MSB radix pass on the first key byte
+      uint64_t offsets[257] = {};
+      for (auto& e : run)
+         offsets[e.key[0] + 1]++;
+      for (unsigned b = 0; b != 256; b++)
+         offsets[b + 1] += offsets[b];
+      std::vector<Entry> partitioned(run.size());
+      uint64_t next[256];
+      std::copy(offsets, offsets + 256, next);
+      for (auto& e : run)
+         partitioned[next[e.key[0]]++] = e;
+      for (unsigned b = 0; b != 256; b++)
+         std::sort(partitioned.begin() + offsets[b], partitioned.begin() + offsets[b + 1], lessFn);
+      run.swap(partitioned);
+   }
+
+public:
+   explicit ParallelSort(unsigned workerCount) : tuples(workerCount), runs(workerCount) {}
+
+   // tuple buffer of the calling worker
+   std::vector<Tuple>& local() { return tuples.local(); }
+
+   // sort all collected tuples; encode(tuple, key) writes the normalized key, cmp is the full comparator
+   template<typename Encode, typename Cmp>
+   void sort(ThreadPool& pool, Encode encode, const Cmp& cmp, bool exact) {
+      unsigned workers = tuples.size();
+      // sort runs
+      pool.parallelFor(
+          workers,
+          [&](uint64_t begin, uint64_t end) {
+             for (uint64_t w = begin; w != end; w++) {
+                auto& run = runs[w];
+                run.resize(tuples[w].size());
+                for (uint64_t i = 0; i != run.size(); i++) {
+                   encode(tuples[w][i], run[i].key.data());
+                   run[i].row = &tuples[w][i];
+                }
+                sortRun(run, cmp, exact);
+             }
+          },
+          1);
+
+      uint64_t total = 0;
+      for (auto& run : runs)
+         total += run.size();
+      result.resize(total);
+      auto lessFn = [&](const Entry& a, const Entry& b) { return less(a, b, cmp, exact); };
+
+      // splitters: evenly spaced samples of all runs
+      unsigned partitions = std::max(1u, std::min<unsigned>(workers * partitionsPerWorker, total / radixThreshold));
+      std::vector<Entry> samples;
+      for (auto& run : runs)
+         for (unsigned s = 1; s != partitions; s++)
+            if (!run.empty())
+               samples.push_back(run[run.size() * s / partitions]);
+      std::sort(samples.begin(), samples.end(), lessFn);
+      std::vector<Entry> splitters;
+      for (unsigned s = 1; s != partitions; s++)
+         splitters.push_back(samples[samples.size() * s / partitions]);
+
+      // bounds[p][w]: start of partition p in run w
+      std::vector<std::vector<uint64_t>> bounds(partitions + 1, std::vector<uint64_t>(workers));
+      for (unsigned w = 0; w != workers; w++) {
+         bounds[partitions][w] = runs[w].size();
+         for (unsigned p = 1; p != partitions; p++)
+            bounds[p][w] = std::lower_bound(runs[w].begin(), runs[w].end(), splitters[p - 1], lessFn) - runs[w].begin();
+      }
+
+      // merge partitions in parallel
+      pool.parallelFor(
+          partitions,
+          [&](uint64_t begin, uint64_t end) {
+             for (uint64_t p = begin; p != end; p++) {
+                uint64_t out = 0;
+                for (unsigned w = 0; w != workers; w++)
+                   out += bounds[p][w];
+                // k-way merge with a min-heap of (run, position)
+                std::vector<std::pair<unsigned, uint64_t>> heap;
+                auto heapCmp = [&](const auto& a, const auto& b) { return lessFn(runs[b.first][b.second], runs[a.first][a.second]); };
+                for (unsigned w = 0; w != workers; w++)
+                   if (bounds[p][w] < bounds[p + 1][w])
+                      heap.push_back({w, bounds[p][w]});
+                std::make_heap(heap.begin(), heap.end(), heapCmp);
+                while (!heap.empty()) {
+                   std::pop_heap(heap.begin(), heap.end(), heapCmp);
+                   auto& [w, pos] = heap.back();
+                   result[out++] = runs[w][pos].row;
+                   if (++pos < bounds[p + 1][w])
+                      std::push_heap(heap.begin(), heap.end(), heapCmp);
+                   else
+                      heap.pop_back();
+                }
+             }
+          },
+          1);
+   }
+
+   // sorted tuples (valid after sort)
+   const std::vector<const Tuple*>& sorted() const { return result; }
+};
+
+}  // namespace p2c
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "types.hpp"
+
+namespace p2c {
+
+// statistics of a column, written by the data generator next to the column file <name>.bin as <name>.stats
+//
+// Text file with one entry per line: the row count, the number of null (empty)
+// fields, an estimate of the number of distinct values (HyperLogLog), min and
+// max, the bounds of an equi-depth histogram, and the most common values with
+// the fraction of rows that hold them. Histogram and most common values are
+// computed from a sample of the column.
+template<typename T>
+struct ColumnStats {
+   // owning type of stored values (strings are copied out of the column)
+   using value_t = std::conditional_t<std::is_same_v<T, std::string_view>, std::string, T>;
+
+   uint64_t rows = 0;
+   uint64_t nulls = 0;
+   double distinct = 0;
+   value_t min{};
+   value_t max{};
+   // bucket i of the histogram holds the values in [bounds[i], bounds[i + 1]]; all buckets hold the same number of rows
+   std::vector<value_t> bounds;
+   // most common values and the fraction of rows that hold them, most common first
+   std::vector<std::pair<value_t, double>> mcvs;
+
+   bool nullFree() const { return nulls == 0; }
+
+   // estimated fraction of rows equal to x
+   double equalFraction(const T& x) const {
+      if (rows == nulls || x < min || max < x)
+         return 0;
+      double common = 0;
+      for (auto& [value, fraction] : mcvs) {
+         if (value == x)
+            return fraction;
+         common += fraction;
+      }
+      // the remaining rows are spread evenly over the remaining values
+      double remaining = std::max(0.0, 1.0 - common - double(nulls) / rows);
+      return remaining / std::max(1.0, distinct - mcvs.size());
+   }
+
+   // estimated fraction of rows less than x (or equal to x)
+   double lessFraction(const T& x, bool orEqual) const {
+      if (rows == nulls || x < min)
+         return 0;
+      double result;
+      if (max < x) {
+         result = 1;
+      } else if (bounds.size() > 1) {
+         // full buckets below x and, within its bucket, the part below x
+         auto bucket = std::upper_bound(bounds.begin(), bounds.end() - 1, x) - bounds.begin() - 1;
+         double within = interpolate(bounds[bucket], bounds[bucket + 1], x);
+         result = (bucket + within) / (bounds.size() - 1);
+      } else {
+         result = interpolate(min, max, x);
+      }
+      result *= 1.0 - double(nulls) / std::max<uint64_t>(rows, 1);
+      if (orEqual)
+         result += equalFraction(x);
+      return std::clamp(result, 0.0, 1.0);
+   }
+
+   void write(const std::string& path) const {
+      std::ofstream out(path);
+      out << "rows " << rows << '\n';
+      out << "nulls " << nulls << '\n';
+      out << "distinct " << format(distinct) << '\n';
+      out << "min " << format(min) << '\n';
+      out << "max " << format(max) << '\n';
+      out << "histogram " << bounds.size() << '\n';
+      for (auto& bound : bounds)
+         out << format(bound) << '\n';
+      out << "mcv " << mcvs.size() << '\n';
+      for (auto& [value, fraction] : mcvs)
+         out << format(fraction) << ' ' << format(value) << '\n';
+   }
+
+   // statistics in the file at path, nullopt if it does not exist or is malformed
+   static std::optional<ColumnStats> read(const std::string& path) {
+      std::ifstream in(path);
+      if (!in)
+         return std::nullopt;
+      ColumnStats s;
+      std::string line;
+      // value of the next line, which starts with 'key '
+      auto entry = [&](std::string_view key) -> std::optional<std::string> {
+         if (!std::getline(in, line) || !line.starts_with(key) || line.size() <= key.size() || line[key.size()] != ' ')
+            return std::nullopt;
+         return line.substr(key.size() + 1);
+      };
+      auto rows = entry("rows"), nulls = entry("nulls"), distinct = entry("distinct"), min = entry("min"), max = entry("max");
+      if (!rows || !nulls || !distinct || !min || !max)
+         return std::nullopt;
+      if (!parse(*rows, s.rows) || !parse(*nulls, s.nulls) || !parse(*distinct, s.distinct) || !parse(*min, s.min) || !parse(*max, s.max))
+         return std::nullopt;
+      auto buckets = entry("histogram");
+      uint64_t n;
+      if (!buckets || !parse(*buckets, n))
+         return std::nullopt;
+      for (value_t bound; s.bounds.size() != n; s.bounds.push_back(bound))
+         if (!std::getline(in, line) || !parse(line, bound))
+            return std::nullopt;
+      auto mcvs = entry("mcv");
+      if (!mcvs || !parse(*mcvs, n))
+         return std::nullopt;
+      s.mcvs.resize(n);
+      for (auto& [value, fraction] : s.mcvs) {
+         if (!std::getline(in, line))
+            return std::nullopt;
+         auto space = line.find(' ');
+         if (space == std::string::npos || !parse(line.substr(0, space), fraction) || !parse(line.substr(space + 1), value))
+            return std::nullopt;
+      }
+      return s;
+   }
+
+private:
+   // numeric value of x, used to interpolate within a histogram bucket
+   static double numeric(const value_t& x) {
+      if constexpr (std::is_same_v<T, date>)
+         return x.value;
+      else
+         return x;
+   }
+
+   // estimated fraction of the values in [lo, hi] that are less than x; half for strings
+   static double interpolate(const value_t& lo, const value_t& hi, const T& x) {
+      if constexpr (std::is_same_v<T, std::string_view>) {
+         return 0.5;
+      } else {
+         if (!(lo < hi))
+            return 0.5;
+         return std::clamp((numeric(x) - numeric(lo)) / (numeric(hi) - numeric(lo)), 0.0, 1.0);
+      }
+   }
+
+   template<typename V>
+   static std::string format(const V& x) {
+      if constexpr (std::is_same_v<V, std::string>) {
+         return x;
+      } else if constexpr (std::is_same_v<V, char>) {
+         return std::string(1, x);
+      } else if constexpr (std::is_same_v<V, date>) {
+         return format(x.value);
+      } else if constexpr (std::is_same_v<V, bool>) {
+         return x ? "1" : "0";
+      } else {
+         char buffer[32];
+         auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), x);
+         return std::string(buffer, end);
+      }
+   }
+
+   template<typename V>
+   static bool parse(std::string_view str, V& x) {
+      if constexpr (std::is_same_v<V, std::string>) {
+         x = str;
+         return true;
+      } else if constexpr (std::is_same_v<V, char>) {
+         x = str.empty() ? '\0' : str[0];
+         return str.size() <= 1;
+      } else if constexpr (std::is_same_v<V, date>) {
+         return parse(str, x.value);
+      } else if constexpr (std::is_same_v<V, bool>) {
+         x = str == "1";
+         return str == "0" || str == "1";
+      } else {
+         auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), x);
+         return ec == std::errc() && end == str.data() + str.size();
+      }
+   }
+};
+
+}  // namespace p2c
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+#include "parallel.hpp"
+
+namespace p2c {
+
+////////////////////////////////////////////////////////////////////////////////
+// Tiered execution: a query starts running in a quickly compiled (unoptimized)
+// build while an optimized build of the same source is compiled in the
+// background. Once it is loaded, the remaining morsels of every pipeline are
+// processed by the optimized build's code for that pipeline. Both builds are
+// compiled from the same source with the same compiler, so the pipelines'
+// closures (references to the query's state) have the same layout and the
+// optimized code can run on the state of the unoptimized build.
+
+// morsel function of a pipeline: calls the pipeline's closure
+using MorselFn = void (*)(void* closure, uint64_t begin, uint64_t end);
+
+// morsel functions of the pipelines of one compiled query, filled when it is loaded
+// (a plain array, so it is zero-initialized before the registrations run)
+struct TierTable {
+   static constexpr unsigned maxPipelines = 1024;
+   MorselFn pipelines[maxPipelines];
+
+   bool add(unsigned pipeline, MorselFn fn) {
+      assert(pipeline < maxPipelines);
+      pipelines[pipeline] = fn;
+      return true;
+   }
+   MorselFn find(unsigned pipeline) const { return pipelines[pipeline]; }
+};
+
+// registers the morsel function of a pipeline (closure type Fn) in table on load
+template<TierTable& table, unsigned pipeline, typename Fn>
+struct TierRegistration {
+   static void call(void* closure, uint64_t begin, uint64_t end) { (*static_cast<Fn*>(closure))(begin, end); }
+   static inline const bool registered = table.add(pipeline, call);
+};
+
+// switches the pipelines of a running query to the optimized tier and counts the tuples each tier processed
+class Tiering {
+   std::atomic<const TierTable*> optimized{nullptr};
+   std::atomic<uint64_t> tuples[2] = {};
+
+public:
+   enum Tier : unsigned { Unoptimized = 0, Optimized = 1 };
+
+   // process the remaining morsels with the optimized build
+   void switchTo(const TierTable* table) { optimized.store(table, std::memory_order_release); }
+
+   uint64_t tupleCount(Tier tier) const { return tuples[tier].load(); }
+
+   // morsel-driven loop of pipeline; each morsel runs in the best tier that is available when it starts
+   template<TierTable& table, unsigned pipeline, typename Fn>
+   void parallelFor(ThreadPool& pool, uint64_t n, Fn& fn) {
+      (void)TierRegistration<table, pipeline, Fn>::registered;
+      pool.parallelFor(n, [&](uint64_t begin, uint64_t end) {
+         const TierTable* tier = optimized.load(std::memory_order_acquire);
+         MorselFn morsel = tier ? tier->find(pipeline) : nullptr;
+         if (morsel)
+            morsel(&fn, begin, end);
+         else
+            fn(begin, end);
+         tuples[morsel ? Optimized : Unoptimized].fetch_add(end - begin, std::memory_order_relaxed);
+      });
+   }
+};
+
+}  // namespace p2c
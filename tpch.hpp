@@ -1,11 +1,14 @@
 // Maximilian Kuschewski, 2023
 #pragma once
+#include <filesystem>
 #include <map>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "io.hpp"
+#include "statistics.hpp"
 #include "types.hpp"
 
 namespace p2c {
@@ -24,13 +27,51 @@ public:
 
    template<typename T>
    struct DataColumnFile : DataColumn<T> {
+      // per-block min/max summaries, empty if the data generator did not write them
+      DataColumn<zone_map::Zone<T>> zones;
+
       DataColumnFile(const Relation* r, const std::string& name)
-          : DataColumn<T>(r->loader->getFullPath(r->name, name)) {}
+          : DataColumn<T>(r->loader->getFullPath(r->name, name)) {
+         if constexpr (!DataColumn<T>::size_tag::IS_VARIABLE) {
+            auto zonePath = r->loader->getZonePath(r->name, name);
+            if (std::filesystem::exists(zonePath)) {
+               zones = DataColumn<zone_map::Zone<T>>(zonePath);
+               // ignore stale zone maps
+               if (zones.size() != zone_map::block_count(this->size()))
+                  zones = {};
+            }
+         }
+      }
+
+      // can any row in [begin, end) satisfy a predicate? fn(min, max) checks a block summary
+      template<typename Fn>
+      bool mayMatch(uint64_t begin, uint64_t end, Fn fn) const {
+         if (!zones.size())
+            return true;
+         for (uint64_t block = begin / zone_map::BLOCK_ROWS; block * zone_map::BLOCK_ROWS < end; block++)
+            if (fn(zones[block].min, zones[block].max))
+               return true;
+         return false;
+      }
    };
 
    std::string getFullPath(const std::string& relation_name, const std::string& name) const {
       return base_path + '/' + relation_name + '/' + name + ".bin";
    }
+
+   std::string getZonePath(const std::string& relation_name, const std::string& name) const {
+      return base_path + '/' + relation_name + '/' + name + ".zones";
+   }
+
+   std::string getStatsPath(const std::string& relation_name, const std::string& name) const {
+      return base_path + '/' + relation_name + '/' + name + ".stats";
+   }
+
+   // statistics of a column, nullopt if the data generator did not write them
+   template<typename T>
+   std::optional<ColumnStats<T>> loadStats(const std::string& relation_name, const std::string& name) const {
+      return ColumnStats<T>::read(getStatsPath(relation_name, name));
+   }
 };
 
 class TPCH : DatabaseAutoload {
@@ -83,7 +83,7 @@ inline char stringToType(const char *str, uint32_t strLen) {
 template<>
 struct type_tag<int64_t> {
    using type = int64_t;
-   static constexpr Type tag = Type::Integer;
+   static constexpr Type tag = Type::BigInt;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -109,6 +109,15 @@ inline std::string_view stringToType(const char *str, uint32_t strLen) {
    return {str, strLen};
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// Bool
+
+template<>
+struct type_tag<bool> {
+   using type = bool;
+   static constexpr Type tag = Type::Bool;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // Double
 
@@ -160,7 +169,7 @@ struct date {
    }
 
    // Julian Day Algorithm from the Calendar FAQ
-   static unsigned toInt(unsigned year, unsigned month, unsigned day) {
+   static constexpr unsigned toInt(unsigned year, unsigned month, unsigned day) {
       unsigned a = (14 - month) / 12;
       unsigned y = year + 4800 - a;
       unsigned m = month + (12 * a) - 3;